@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "bench-options.h"
+
+static std::vector<std::string> SplitFlags(const std::string &flags)
+{
+  std::vector<std::string> tokens;
+  std::string current;
+  for (char c : flags) {
+    if (c == ' ' || c == '\t' || c == '\n' || c == ',') {
+      if (!current.empty()) tokens.push_back(std::move(current));
+      current.clear();
+    } else {
+      current.push_back(c);
+    }
+  }
+  if (!current.empty()) tokens.push_back(std::move(current));
+  return tokens;
+}
+
+// Parses a decimal number with an optional K/M/G (binary) suffix.
+static bool ParseNumber(const std::string &name, const std::string &value, uint64_t *out)
+{
+  char *end = nullptr;
+  unsigned long long n = strtoull(value.c_str(), &end, 10);
+  if (end == value.c_str()) {
+    fprintf(stderr, "sm-bench: invalid value for '%s': '%s'\n", name.c_str(), value.c_str());
+    return false;
+  }
+  switch (*end) {
+    case 'k': case 'K': n <<= 10; end++; break;
+    case 'm': case 'M': n <<= 20; end++; break;
+    case 'g': case 'G': n <<= 30; end++; break;
+  }
+  if (*end != '\0') {
+    fprintf(stderr, "sm-bench: invalid value for '%s': '%s'\n", name.c_str(), value.c_str());
+    return false;
+  }
+  *out = n;
+  return true;
+}
+
+static bool ParseNumber(const std::string &name, const std::string &value, uint32_t *out)
+{
+  uint64_t n;
+  if (!ParseNumber(name, value, &n)) return false;
+  if (n > UINT32_MAX) {
+    fprintf(stderr, "sm-bench: value for '%s' is too large: '%s'\n", name.c_str(), value.c_str());
+    return false;
+  }
+  *out = (uint32_t)n;
+  return true;
+}
+
+// Parses "<type>:<value>" with type one of i32, i64, f32, f64.
+static bool ParseWasmArg(const std::string &value, WasmArg *out)
+{
+  size_t colon = value.find(':');
+  std::string type = value.substr(0, colon);
+  const char *number = colon == std::string::npos ? "" : value.c_str() + colon + 1;
+  char *end = nullptr;
+  if (type == "i32" || type == "i64") {
+    out->type = type == "i32" ? WasmArg::I32 : WasmArg::I64;
+    out->i64 = strtoll(number, &end, 0);
+  } else if (type == "f32" || type == "f64") {
+    out->type = type == "f32" ? WasmArg::F32 : WasmArg::F64;
+    out->f64 = strtod(number, &end);
+  }
+  if (!end || end == number || *end != '\0') {
+    fprintf(stderr, "sm-bench: invalid argument '%s', expected <i32|i64|f32|f64>:<value>\n",
+            value.c_str());
+    return false;
+  }
+  return true;
+}
+
+const char* WasmTierName(const BenchOptions &options)
+{
+  if (options.wasm_baseline && options.wasm_ion) return "tier";
+  return options.wasm_baseline ? "baseline" : "ion";
+}
+
+bool ParseBenchOptions(const std::string &flags, BenchOptions *out)
+{
+  for (std::string token : SplitFlags(flags)) {
+    if (token.compare(0, 2, "--") == 0) token.erase(0, 2);
+
+    std::string name = token, value;
+    bool has_value = false;
+    size_t eq = token.find('=');
+    if (eq != std::string::npos) {
+      name = token.substr(0, eq);
+      value = token.substr(eq + 1);
+      has_value = true;
+    }
+
+    if (name == "baseline" && !has_value) {
+      out->wasm_ion = false;
+      out->wasm_baseline = true;
+    } else if (name == "ion" && !has_value) {
+      out->wasm_ion = true;
+      out->wasm_baseline = false;
+    } else if (name == "tier" && !has_value) {
+      out->wasm_baseline = true;
+    } else if (name == "perf") {
+      // "func" makes SpiderMonkey write /tmp/perf-<pid>.map entries for
+      // every compiled function, wasm included, and "block" one per basic
+      // block. mozjs-102 exits the process on any other IONPERF value.
+      out->perf = has_value ? value : "func";
+      if (out->perf != "none" && out->perf != "block" && out->perf != "func") {
+        fprintf(stderr, "sm-bench: invalid perf mode '%s', expected none, block or func\n",
+                out->perf.c_str());
+        return false;
+      }
+    } else if (name == "no-huge-memory" && !has_value) {
+      out->no_huge_memory = true;
+    } else if (name == "thp" && !has_value) {
+      out->thp = true;
+    } else if (name == "pretouch" && !has_value) {
+      out->pretouch = true;
+    } else if (name == "memory-initial" && has_value) {
+      if (!ParseNumber(name, value, &out->memory_initial_pages)) return false;
+    } else if (name == "memory-maximum" && has_value) {
+      if (!ParseNumber(name, value, &out->memory_maximum_pages)) return false;
+    } else if (name == "snapshot" && !has_value) {
+      out->snapshot = true;
+    } else if (name == "snapshot-init" && has_value && !value.empty()) {
+      out->snapshot = true;
+      out->snapshot_init = value;
+    } else if (name == "invoke" && has_value && !value.empty()) {
+      out->invoke = value;
+    } else if (name == "arg" && has_value) {
+      WasmArg arg;
+      if (!ParseWasmArg(value, &arg)) return false;
+      out->args.push_back(arg);
+    } else if (name == "iterations" && has_value) {
+      if (!ParseNumber(name, value, &out->iterations)) return false;
+    } else if (name == "fast-create" && !has_value) {
+      out->fast_create = true;
+    } else if (name == "reuse-context" && !has_value) {
+      out->reuse_context = true;
+    } else if (name == "fast-teardown" && !has_value) {
+      out->fast_teardown = true;
+    } else if (name == "suite-serial" && !has_value) {
+      out->suite_serial = true;
+    } else if (name == "compile-throughput" && has_value) {
+      if (!ParseNumber(name, value, &out->compile_throughput)) return false;
+    } else if (name == "instances" && has_value) {
+      if (!ParseNumber(name, value, &out->instances)) return false;
+    } else if (name == "instances-keep" && !has_value) {
+      out->instances_keep = true;
+    } else if (name == "profile" && has_value && !value.empty()) {
+      out->profile = value;
+    } else if (name == "profile-interval" && has_value) {
+      if (!ParseNumber(name, value, &out->profile_interval_us)) return false;
+    } else if (name == "report") {
+      out->report = true;
+      out->report_path = value;
+    } else if (name == "gc-before-phase" && !has_value) {
+      out->gc_before_phase = true;
+    } else if (name == "heap-max" && has_value) {
+      if (!ParseNumber(name, value, &out->heap_max_bytes)) return false;
+    } else if (name == "nursery" && has_value) {
+      if (!ParseNumber(name, value, &out->nursery_bytes)) return false;
+    } else {
+      fprintf(stderr, "sm-bench: unknown execution flag '%s'\n", token.c_str());
+      return false;
+    }
+  }
+
+  if (out->invoke == "_start" && (out->iterations != 1 || !out->args.empty())) {
+    // `_start` starts and stops the execution timer itself.
+    fprintf(stderr, "sm-bench: 'iterations' and 'arg' require 'invoke'\n");
+    return false;
+  }
+  if (out->iterations == 0) {
+    fprintf(stderr, "sm-bench: 'iterations' must be at least 1\n");
+    return false;
+  }
+  return true;
+}
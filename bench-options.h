@@ -0,0 +1,113 @@
+#ifndef BENCH_OPTIONS_H
+#define BENCH_OPTIONS_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+/// A typed argument for the invoked export, see `BenchOptions::invoke`.
+struct WasmArg {
+    enum Type { I32, I64, F32, F64 };
+    Type type;
+    int64_t i64;
+    double f64;
+};
+
+/// Options parsed from the `execution_flags` string. Flags are separated by
+/// whitespace or commas, e.g. "ion perf". A leading `--` on a flag is
+/// accepted and ignored.
+struct BenchOptions {
+    bool wasm_baseline = false;
+    bool wasm_ion = true;
+
+    /// Value for SpiderMonkey's `IONPERF` environment variable (`none`,
+    /// `block` or `func`), or empty if perf map emission is disabled.
+    /// Process-wide, see `EnsureEngineInitialized`.
+    std::string perf;
+
+    /// Disable 4GB+guard "huge memory" reservations for wasm memories so
+    /// that accesses use explicit bounds checks. Process-wide.
+    bool no_huge_memory = false;
+
+    /// madvise(MADV_HUGEPAGE) the linear memory after instantiation and
+    /// after every growth.
+    bool thp = false;
+
+    /// Fault in the committed linear memory after instantiation, before the
+    /// execution timer can start.
+    bool pretouch = false;
+
+    /// Size, in 64KiB pages, of the memories the driver creates for modules
+    /// that import their memory. The initial size also pre-grows exported
+    /// memories after instantiation. 0 uses the module's declared limits.
+    uint64_t memory_initial_pages = 0;
+    uint64_t memory_maximum_pages = 0;
+
+    /// Snapshot linear memory and exported mutable globals after
+    /// instantiation, after calling `snapshot_init` if set, and restore them
+    /// before every execution but the first.
+    bool snapshot = false;
+    std::string snapshot_init;
+
+    /// The export run by `wasm_bench_execute`. For anything but `_start` the
+    /// driver times the calls itself, calling the export `iterations` times
+    /// in a loop with `args`.
+    std::string invoke = "_start";
+    std::vector<WasmArg> args;
+    uint32_t iterations = 1;
+
+    /// Initialize self-hosted code of new contexts from a stencil cached by
+    /// the first context in the process, and create the global without
+    /// notifying the debugger.
+    bool fast_create = false;
+
+    /// Return the context and global to a per-thread pool on
+    /// `wasm_bench_free` and reuse them in the next `wasm_bench_create`
+    /// with the same heap settings.
+    bool reuse_context = false;
+
+    /// Don't destroy the context in `wasm_bench_free`: the next
+    /// `wasm_bench_create` on the thread destroys it before its timings
+    /// start, or it is left to the OS at process exit.
+    bool fast_teardown = false;
+
+    /// Compile the modules of `wasm_bench_run_suite` one after the other on
+    /// the calling thread instead of one ahead on a background thread.
+    bool suite_serial = false;
+
+    /// After the measured compilation, compile and validate the module this
+    /// many more times and report throughput normalized by module shape.
+    uint32_t compile_throughput = 0;
+
+    /// Instantiate the module `instances` more times after the measured
+    /// instantiation, timing each one, to find per-instance latency and
+    /// memory cost. With `instances_keep` every instance stays alive until
+    /// `wasm_bench_free`, otherwise each is dropped right away.
+    uint32_t instances = 0;
+    bool instances_keep = false;
+
+    /// Path to append folded stacks of the execution phase to, or empty if
+    /// the sampling profiler is disabled.
+    std::string profile;
+    uint32_t profile_interval_us = 1000;
+
+    /// Write per-phase statistics to `report_path`, or to stderr if the path
+    /// is empty.
+    bool report = false;
+    std::string report_path;
+
+    /// Run a full non-incremental GC before each timed phase.
+    bool gc_before_phase = false;
+    /// GC heap limit passed to `JS_NewContext`; 0 for the default.
+    uint32_t heap_max_bytes = 0;
+    /// Maximum nursery size; 0 for the default.
+    uint32_t nursery_bytes = 0;
+};
+
+/// "baseline", "ion" or "tier", for reports.
+const char* WasmTierName(const BenchOptions &options);
+
+bool ParseBenchOptions(const std::string &flags, BenchOptions *out);
+
+#endif // BENCH_OPTIONS_H
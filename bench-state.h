@@ -2,19 +2,41 @@
 #define BENCH_STATE_H
 
 #include <jsapi.h>
+#include <js/WasmModule.h>
+
+#include <stdio.h>
 
 #include <string>
 #include <vector>
 #include <optional>
 #include <fstream>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "bench-options.h"
+#include "profiler.h"
+#include "phases.h"
+#include "wasm-module-info.h"
+#include "snapshot.h"
 
 struct JSEngineState {
     JSContext *cx;
     JS::PersistentRootedObject global;
     JS::PersistentRootedObject module;
     JS::PersistentRootedObject instance;
+    // The export called by `wasm_bench_execute`.
+    JS::PersistentRootedObject entry;
+    // Extra instances kept alive by `instances-keep`.
+    JS::PersistentRootedObject kept_instances;
+    // The imports bag, built once and reused by every instantiation; only
+    // imported memories are replaced per instance.
+    JS::PersistentRootedObject imports;
 
-    JSEngineState(JSContext *cx_) : cx(cx_), global(cx_), module(cx_), instance(cx_) {}
+    JSEngineState(JSContext *cx_)
+      : cx(cx_), global(cx_), module(cx_), instance(cx_), entry(cx_), kept_instances(cx_),
+        imports(cx_) {}
 };
 
 struct FdEntry {
@@ -30,13 +52,79 @@ struct FdEntry {
 
 const size_t PREOPEN_DIR_FD = 3;
 
+/// A change of the linear memory's length noticed by `ObserveWasmMemory`.
+struct MemoryGrowth {
+    size_t old_length;
+    size_t new_length;
+    bool moved;
+    uint64_t observed_ns;
+};
+
+/// Cumulative counters, snapshotted at the start of every phase and diffed
+/// against at its end.
+struct PhaseCounters {
+    uint64_t time_ns = 0;
+    uint64_t major_gc_count = 0;
+    uint64_t major_gc_ns = 0;
+    uint64_t minor_gc_count = 0;
+    uint64_t minor_gc_ns = 0;
+    uint64_t minor_faults = 0;
+    uint64_t major_faults = 0;
+};
+
 struct BenchState {
     typedef void (*TimerCallback)(void *timer);
 
     std::optional<JSEngineState> js;
 
     std::optional<std::string> execution_flags;
+    BenchOptions options;
+    WasmModuleInfo module_info;
+    // The module as compiled, if the driver added to it; see
+    // `AddGlobalAccessors`.
+    std::vector<uint8_t> instrumented_wasm;
     std::vector<std::optional<FdEntry>> fd_table;
+    // Guards `fd_table`, which WASI calls from wasi-threads threads share.
+    std::mutex fd_mutex;
+
+    // The compiled module, shareable with other threads' contexts.
+    RefPtr<JS::WasmModule> wasm_module;
+    std::thread::id main_thread;
+    JSRuntime *parent_runtime = nullptr;
+    // The context came from the `reuse-context` pool.
+    bool context_reused = false;
+    std::atomic<int32_t> next_thread_id{1};
+
+    // Set by the first `proc_exit` of any thread; a wasi-threads exit ends
+    // the whole process.
+    std::atomic<bool> exited{false};
+    std::atomic<int32_t> exit_code{0};
+    // Every wasi-threads thread, the main one included, stops at its next
+    // interrupt check once this is set.
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> thread_trapped{false};
+    // Guards `threads` and `thread_contexts`.
+    std::mutex threads_mutex;
+    std::vector<std::thread> threads;
+    // Contexts of the spawned threads still running.
+    std::vector<JSContext*> thread_contexts;
+
+    std::unique_ptr<SamplingProfiler> profiler;
+    std::unique_ptr<InstanceSnapshot> snapshot;
+    size_t executions = 0;
+
+    // Linear memory as last seen by `ObserveWasmMemory`.
+    uint8_t *memory_base = nullptr;
+    size_t memory_length = 0;
+    size_t memory_high_water = 0;
+    std::vector<MemoryGrowth> memory_growths;
+
+    FILE *report = nullptr;
+    PhaseCounters counters;
+    PhaseCounters phase_start;
+    PhaseCounters phase_end;
+    uint64_t gc_slice_start_ns = 0;
+    uint64_t minor_gc_start_ns = 0;
 
     void *compilation_timer;
     TimerCallback compilation_start;
@@ -49,6 +137,11 @@ struct BenchState {
     void *execution_timer;
     TimerCallback execution_start;
     TimerCallback execution_end;
+
+    ~BenchState()
+    {
+        if (report && report != stderr) fclose(report);
+    }
 };
 
 #endif // BENCH_STATE_H
@@ -0,0 +1,261 @@
+#include <jsapi.h>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "memory-stats.h"
+#include "bench-state.h"
+#include "wasi-imports.h"
+
+#ifdef __linux__
+struct MapsEntry {
+  uintptr_t start;
+  uintptr_t end;
+  char perms[5];
+  unsigned long inode;
+  bool has_path;
+};
+
+static bool ParseMapsLine(const char *line, MapsEntry *entry)
+{
+  int path_offset = 0;
+  if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR " %4s %*s %*s %lu %n",
+             &entry->start, &entry->end, entry->perms, &entry->inode, &path_offset) < 4) {
+    return false;
+  }
+  entry->has_path = path_offset > 0 && line[path_offset] != '\0' && line[path_offset] != '\n';
+  return true;
+}
+
+static bool IsAnonymous(const MapsEntry &entry)
+{
+  return entry.inode == 0 && !entry.has_path;
+}
+
+// Sums committed anonymous executable mappings, which is where the JIT
+// places code of all tiers, and finds the reservation holding the linear
+// memory: the mapping containing `base` plus the contiguous anonymous
+// PROT_NONE mappings that follow it (the guard region). Any other mapping
+// above it is unrelated, e.g. a GC chunk or malloc arena placed next to it.
+static void ScanMaps(uintptr_t base, uint64_t *executable_bytes, uint64_t *reserved_bytes)
+{
+  FILE *maps = fopen("/proc/self/maps", "r");
+  if (!maps) return;
+
+  char line[4096];
+  bool in_reservation = false;
+  uintptr_t reservation_end = 0;
+  while (fgets(line, sizeof(line), maps)) {
+    MapsEntry entry;
+    if (!ParseMapsLine(line, &entry)) continue;
+
+    if (IsAnonymous(entry) && entry.perms[2] == 'x') {
+      *executable_bytes += entry.end - entry.start;
+    }
+
+    if (base && entry.start <= base && base < entry.end) {
+      in_reservation = true;
+      reservation_end = entry.end;
+    } else if (in_reservation && entry.start == reservation_end &&
+               IsAnonymous(entry) && strncmp(entry.perms, "---", 3) == 0) {
+      reservation_end = entry.end;
+    } else {
+      in_reservation = false;
+    }
+  }
+  if (reservation_end) {
+    *reserved_bytes = reservation_end - base;
+  }
+  fclose(maps);
+}
+
+// Sums AnonHugePages of the smaps entries overlapping [base, base + length).
+static uint64_t HugePageBytes(uintptr_t base, size_t length)
+{
+  FILE *smaps = fopen("/proc/self/smaps", "r");
+  if (!smaps) return 0;
+
+  char line[4096];
+  bool overlaps = false;
+  uint64_t total = 0;
+  while (fgets(line, sizeof(line), smaps)) {
+    MapsEntry entry;
+    unsigned long kb;
+    if (ParseMapsLine(line, &entry)) {
+      overlaps = entry.start < base + length && base < entry.end;
+    } else if (overlaps && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+      total += (uint64_t)kb * 1024;
+    }
+  }
+  fclose(smaps);
+  return total;
+}
+
+static uint64_t CurrentRss()
+{
+  uint64_t rss, virtual_size;
+  ProcessFootprint(&rss, &virtual_size);
+  return rss;
+}
+#endif
+
+void ProcessFootprint(uint64_t *rss_bytes, uint64_t *virtual_bytes)
+{
+  *rss_bytes = 0;
+  *virtual_bytes = 0;
+#ifdef __linux__
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (!statm) return;
+  unsigned long size = 0, resident = 0;
+  if (fscanf(statm, "%lu %lu", &size, &resident) == 2) {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    *rss_bytes = (uint64_t)resident * page_size;
+    *virtual_bytes = (uint64_t)size * page_size;
+  }
+  fclose(statm);
+#endif
+}
+
+static uint64_t PeakRss()
+{
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+  return usage.ru_maxrss;
+#else
+  return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+void CollectMemoryStats(BenchState *bench, WasmBenchMemoryStats *out)
+{
+  memset(out, 0, sizeof(*out));
+  JSContext *cx = bench->js->cx;
+
+  out->peak_rss_bytes = PeakRss();
+  out->js_heap_bytes = JS_GetGCParameter(cx, JSGC_BYTES);
+  out->linear_memory_high_water_bytes = bench->memory_high_water;
+
+  uint8_t *data = nullptr;
+  size_t length = 0;
+  JS::RootedValue memory(cx);
+  if (JS_GetProperty(cx, bench->js->global, "memory", &memory) && memory.isObject()) {
+    if (GetWasmMemory(cx, bench->js->global, &data, &length)) {
+      out->linear_memory_bytes = length;
+    } else {
+      JS_ClearPendingException(cx);
+    }
+  } else {
+    JS_ClearPendingException(cx);
+  }
+
+#ifdef __linux__
+  out->rss_bytes = CurrentRss();
+  uint64_t reserved = 0;
+  ScanMaps((uintptr_t)data, &out->executable_bytes, &reserved);
+  out->linear_memory_reserved_bytes = reserved;
+  if (bench->options.thp && data) {
+    out->linear_memory_huge_page_bytes = HugePageBytes((uintptr_t)data, length);
+  }
+#endif
+}
+
+void PrefaultWasmMemory(uint8_t *data, size_t length)
+{
+#ifdef MADV_POPULATE_WRITE
+  if (madvise(data, length, MADV_POPULATE_WRITE) == 0) return;
+#endif
+  // Rewrite one byte per page; reading alone would only map the zero page.
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  for (size_t offset = 0; offset < length; offset += page_size) {
+    volatile uint8_t *p = data + offset;
+    *p = *p;
+  }
+}
+
+uint64_t MinorFaultCostNs()
+{
+  static uint64_t cost_ns = 0;
+  static bool measured = false;
+  if (measured) return cost_ns;
+  measured = true;
+
+  const size_t length = 16 << 20;
+  void *region = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED) return 0;
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  uint64_t start = MonotonicNs();
+  for (size_t offset = 0; offset < length; offset += page_size) {
+    static_cast<volatile uint8_t*>(region)[offset] = 1;
+  }
+  cost_ns = (MonotonicNs() - start) / (length / page_size);
+  munmap(region, length);
+  return cost_ns;
+}
+
+void ObserveWasmMemory(BenchState *bench, uint8_t *data, size_t length)
+{
+  // Growth tracking and madvise hints follow the main thread's view only.
+  if (std::this_thread::get_id() != bench->main_thread) return;
+  if (data == bench->memory_base && length == bench->memory_length) return;
+  // Growth is only noticed when the driver looks at the memory, so several
+  // memory.grow calls between two host calls show up as a single event.
+  // Events are only consumed by the report, which also clears them.
+  if (bench->report && bench->memory_base && length != bench->memory_length) {
+    bench->memory_growths.push_back(
+      {bench->memory_length, length, data != bench->memory_base, MonotonicNs()});
+  }
+  bench->memory_base = data;
+  bench->memory_length = length;
+  if (length > bench->memory_high_water) {
+    bench->memory_high_water = length;
+  }
+
+  if (bench->options.thp && data && length) {
+#ifdef MADV_HUGEPAGE
+    // The base is page aligned and the kernel rounds the length up.
+    if (madvise(data, length, MADV_HUGEPAGE) != 0) {
+      perror("sm-bench: madvise(MADV_HUGEPAGE)");
+    }
+#endif
+  }
+}
+
+// Huge memory reserves at least 4GiB per memory, explicit bounds checks only
+// the declared maximum plus a small guard.
+static const char* ObservedBoundsChecks(const WasmBenchMemoryStats &stats)
+{
+  if (!stats.linear_memory_reserved_bytes) return "unknown";
+  return stats.linear_memory_reserved_bytes >= (4ull << 30) ? "huge-memory" : "explicit";
+}
+
+void ReportMemoryStats(BenchState *bench, const char *phase)
+{
+  if (!bench->report) return;
+  WasmBenchMemoryStats stats;
+  CollectMemoryStats(bench, &stats);
+  BenchReport(bench, "phase=%s rss=%" PRIu64 " peak_rss=%" PRIu64
+              " js_heap=%" PRIu64 " executable=%" PRIu64
+              " linear_memory=%" PRIu64 " linear_memory_reserved=%" PRIu64
+              " linear_memory_huge_pages=%" PRIu64 " linear_memory_high_water=%" PRIu64
+              " bounds_checks=%s",
+              phase, stats.rss_bytes, stats.peak_rss_bytes, stats.js_heap_bytes,
+              stats.executable_bytes, stats.linear_memory_bytes,
+              stats.linear_memory_reserved_bytes, stats.linear_memory_huge_page_bytes,
+              stats.linear_memory_high_water_bytes, ObservedBoundsChecks(stats));
+}
+
+void ReportMemoryGrowths(BenchState *bench, const char *phase, uint64_t phase_start_ns)
+{
+  for (const MemoryGrowth &growth : bench->memory_growths) {
+    BenchReport(bench, "phase=%s memory_grow old=%zu new=%zu moved=%d observed_at_ns=%" PRId64,
+                phase, growth.old_length, growth.new_length, growth.moved ? 1 : 0,
+                (int64_t)(growth.observed_ns - phase_start_ns));
+  }
+  bench->memory_growths.clear();
+}
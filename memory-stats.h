@@ -0,0 +1,36 @@
+#ifndef MEMORY_STATS_H
+#define MEMORY_STATS_H
+
+#include "sm-bench.h"
+
+struct BenchState;
+
+/// Fills `out` with the current memory footprint of the process and of the
+/// bench's instance. Must be called inside the bench's realm. Values that
+/// can't be determined on this platform are left at 0.
+void CollectMemoryStats(BenchState *bench, WasmBenchMemoryStats *out);
+
+/// Current resident set and virtual address space size of the process, or 0
+/// where unavailable.
+void ProcessFootprint(uint64_t *rss_bytes, uint64_t *virtual_bytes);
+
+/// Called whenever the driver looks at the linear memory, to notice growth
+/// and (re)apply madvise hints to new ranges.
+void ObserveWasmMemory(BenchState *bench, uint8_t *data, size_t length);
+
+/// Faults in every page of the linear memory with write access, so that
+/// first-touch faults don't land in the execution phase.
+void PrefaultWasmMemory(uint8_t *data, size_t length);
+
+/// Average cost of a first-touch minor fault on anonymous memory, measured
+/// once per process.
+uint64_t MinorFaultCostNs();
+
+/// Reports `CollectMemoryStats` for the end of `phase`.
+void ReportMemoryStats(BenchState *bench, const char *phase);
+
+/// Reports and clears the growth events recorded since the last call.
+/// Event times are relative to `phase_start_ns`.
+void ReportMemoryGrowths(BenchState *bench, const char *phase, uint64_t phase_start_ns);
+
+#endif // MEMORY_STATS_H
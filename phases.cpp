@@ -0,0 +1,164 @@
+#include <jsapi.h>
+#include <js/GCAPI.h>
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "phases.h"
+#include "bench-state.h"
+#include "memory-stats.h"
+
+const char* PhaseName(BenchPhase phase)
+{
+  switch (phase) {
+    case BenchPhase::Compilation: return "compilation";
+    case BenchPhase::Instantiation: return "instantiation";
+    case BenchPhase::Execution: return "execution";
+  }
+  return "unknown";
+}
+
+uint64_t MonotonicNs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void BenchReport(BenchState *bench, const char *fmt, ...)
+{
+  if (!bench->report) return;
+  va_list args;
+  va_start(args, fmt);
+  fputs("sm-bench: ", bench->report);
+  vfprintf(bench->report, fmt, args);
+  fputc('\n', bench->report);
+  fflush(bench->report);
+  va_end(args);
+}
+
+static void GcSliceCallback(JSContext *cx, JS::GCProgress progress, const JS::GCDescription &desc)
+{
+  BenchState* bench = static_cast<BenchState*>(JS_GetContextPrivate(cx));
+  if (!bench) return;
+  switch (progress) {
+    case JS::GC_SLICE_BEGIN:
+      bench->gc_slice_start_ns = MonotonicNs();
+      break;
+    case JS::GC_SLICE_END:
+      bench->counters.major_gc_ns += MonotonicNs() - bench->gc_slice_start_ns;
+      break;
+    case JS::GC_CYCLE_END:
+      bench->counters.major_gc_count++;
+      break;
+    default:
+      break;
+  }
+}
+
+static void GcNurseryCallback(JSContext *cx, JS::GCNurseryProgress progress, JS::GCReason reason)
+{
+  BenchState* bench = static_cast<BenchState*>(JS_GetContextPrivate(cx));
+  if (!bench) return;
+  if (progress == JS::GCNurseryProgress::GC_NURSERY_COLLECTION_START) {
+    bench->minor_gc_start_ns = MonotonicNs();
+  } else {
+    bench->counters.minor_gc_ns += MonotonicNs() - bench->minor_gc_start_ns;
+    bench->counters.minor_gc_count++;
+  }
+}
+
+void InstallGcAccounting(JSContext *cx)
+{
+  JS::SetGCSliceCallback(cx, GcSliceCallback);
+  JS::SetGCNurseryCollectionCallback(cx, GcNurseryCallback);
+}
+
+void UninstallGcAccounting(JSContext *cx)
+{
+  JS::SetGCSliceCallback(cx, nullptr);
+  JS::SetGCNurseryCollectionCallback(cx, nullptr);
+}
+
+static void SnapshotCounters(BenchState *bench, PhaseCounters *out)
+{
+  *out = bench->counters;
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    out->minor_faults = usage.ru_minflt;
+    out->major_faults = usage.ru_majflt;
+  }
+  out->time_ns = MonotonicNs();
+}
+
+void PhaseStart(BenchState *bench, BenchPhase phase)
+{
+  if (bench->options.gc_before_phase) {
+    JSContext *cx = bench->js->cx;
+    JS::PrepareForFullGC(cx);
+    JS::NonIncrementalGC(cx, JS::GCOptions::Normal, JS::GCReason::API);
+  }
+
+  SnapshotCounters(bench, &bench->phase_start);
+
+  switch (phase) {
+    case BenchPhase::Compilation:
+      bench->compilation_start(bench->compilation_timer);
+      break;
+    case BenchPhase::Instantiation:
+      bench->instantiation_start(bench->instantiation_timer);
+      break;
+    case BenchPhase::Execution:
+      bench->execution_start(bench->execution_timer);
+      if (bench->profiler) bench->profiler->SetActive(true);
+      break;
+  }
+}
+
+void PhaseEnd(BenchState *bench, BenchPhase phase)
+{
+  switch (phase) {
+    case BenchPhase::Compilation:
+      bench->compilation_end(bench->compilation_timer);
+      break;
+    case BenchPhase::Instantiation:
+      bench->instantiation_end(bench->instantiation_timer);
+      break;
+    case BenchPhase::Execution:
+      if (bench->profiler) bench->profiler->SetActive(false);
+      bench->execution_end(bench->execution_timer);
+      break;
+  }
+
+  SnapshotCounters(bench, &bench->phase_end);
+}
+
+void ReportPhase(BenchState *bench, BenchPhase phase)
+{
+  if (!bench->report) return;
+  const PhaseCounters &start = bench->phase_start;
+  const PhaseCounters &end = bench->phase_end;
+  uint64_t time_ns = end.time_ns - start.time_ns;
+  uint64_t minor_faults = end.minor_faults - start.minor_faults;
+  // Minor faults are estimated at the cost measured for first-touch faults
+  // on fresh anonymous memory; major faults are counted but not estimated.
+  uint64_t fault_ns = minor_faults * MinorFaultCostNs();
+  uint64_t time_excl_faults_ns = time_ns > fault_ns ? time_ns - fault_ns : 0;
+  BenchReport(bench, "phase=%s context=%s time_ns=%" PRIu64
+              " major_gcs=%" PRIu64 " major_gc_ns=%" PRIu64
+              " minor_gcs=%" PRIu64 " minor_gc_ns=%" PRIu64
+              " minor_faults=%" PRIu64 " major_faults=%" PRIu64
+              " est_fault_ns=%" PRIu64 " time_excl_faults_ns=%" PRIu64,
+              PhaseName(phase), bench->context_reused ? "reused" : "fresh", time_ns,
+              end.major_gc_count - start.major_gc_count,
+              end.major_gc_ns - start.major_gc_ns,
+              end.minor_gc_count - start.minor_gc_count,
+              end.minor_gc_ns - start.minor_gc_ns,
+              minor_faults, end.major_faults - start.major_faults,
+              fault_ns, time_excl_faults_ns);
+  ReportMemoryStats(bench, PhaseName(phase));
+  ReportMemoryGrowths(bench, PhaseName(phase), start.time_ns);
+}
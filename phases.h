@@ -0,0 +1,38 @@
+#ifndef PHASES_H
+#define PHASES_H
+
+#include <jsapi.h>
+
+#include <stdint.h>
+
+struct BenchState;
+
+enum class BenchPhase {
+    Compilation,
+    Instantiation,
+    Execution,
+};
+
+const char* PhaseName(BenchPhase phase);
+
+uint64_t MonotonicNs();
+
+/// Writes one "sm-bench: ..." line to the report output, if reporting is
+/// enabled with the `report` flag.
+void BenchReport(BenchState *bench, const char *fmt, ...)
+  __attribute__((format(printf, 2, 3)));
+
+/// Installs the GC callbacks used for per-phase GC accounting.
+void InstallGcAccounting(JSContext *cx);
+void UninstallGcAccounting(JSContext *cx);
+
+/// Start/stop the embedder's timer for `phase`. Everything the driver does
+/// for its own bookkeeping happens before the timer starts or after it ends.
+void PhaseStart(BenchState *bench, BenchPhase phase);
+void PhaseEnd(BenchState *bench, BenchPhase phase);
+
+/// Reports the statistics of the last phase. Called once the driver is done
+/// with the phase's results, e.g. after the instance's memory is known.
+void ReportPhase(BenchState *bench, BenchPhase phase);
+
+#endif // PHASES_H
@@ -0,0 +1,118 @@
+#include <jsapi.h>
+#include <jsfriendapi.h>
+
+#include <js/ProfilingFrameIterator.h>
+#include <js/ProfilingStack.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <stdio.h>
+
+#include "profiler.h"
+#include "bench-state.h"
+
+static const size_t MAX_FRAMES_PER_ENTRY = 16;
+static const size_t RESERVED_FRAMES = 1 << 20;
+
+static bool SampleInterruptCallback(JSContext *cx)
+{
+  BenchState* bench = static_cast<BenchState*>(JS_GetContextPrivate(cx));
+  if (bench && bench->profiler) {
+    bench->profiler->Sample();
+  }
+  return true;
+}
+
+SamplingProfiler::SamplingProfiler(JSContext *cx, uint32_t interval_us)
+  : cx_(cx), interval_us_(interval_us), running_(false), active_(false) {}
+
+SamplingProfiler::~SamplingProfiler()
+{
+  Stop();
+  js::EnableContextProfilingStack(cx_, false);
+}
+
+bool SamplingProfiler::Init()
+{
+  // Profiling mode makes wasm code maintain the frame pointers and labels
+  // that the profiling frame iterator relies on.
+  js::SetContextProfilingStack(cx_, &profiling_stack_);
+  js::EnableContextProfilingStack(cx_, true);
+  if (!JS_AddInterruptCallback(cx_, SampleInterruptCallback)) return false;
+  // Avoid reallocations while sampling inside the timed window.
+  frames_.reserve(RESERVED_FRAMES);
+  return true;
+}
+
+void SamplingProfiler::Start()
+{
+  if (running_) return;
+  running_ = true;
+  thread_ = std::thread([this] { Run(); });
+}
+
+void SamplingProfiler::Stop()
+{
+  active_ = false;
+  if (!running_) return;
+  running_ = false;
+  thread_.join();
+}
+
+void SamplingProfiler::Run()
+{
+  while (running_) {
+    std::this_thread::sleep_for(std::chrono::microseconds(interval_us_));
+    if (active_) {
+      JS_RequestInterruptCallback(cx_);
+    }
+  }
+}
+
+void SamplingProfiler::Sample()
+{
+  if (!active_) return;
+
+  size_t begin = frames_.size();
+  JS::ProfilingFrameIterator::RegisterState state;
+  for (JS::ProfilingFrameIterator it(cx_, state); !it.done(); ++it) {
+    JS::ProfilingFrameIterator::Frame frames[MAX_FRAMES_PER_ENTRY];
+    uint32_t count = it.extractStack(frames, 0, MAX_FRAMES_PER_ENTRY);
+    for (uint32_t i = 0; i < count; i++) {
+      frames_.push_back(frames[i].label);
+    }
+  }
+  // The iterator walks from the youngest frame; folded stacks are rooted.
+  std::reverse(frames_.begin() + begin, frames_.end());
+  sample_ends_.push_back(frames_.size());
+}
+
+bool SamplingProfiler::WriteFoldedStacks(const std::string &path)
+{
+  std::map<std::string, size_t> stacks;
+  size_t begin = 0;
+  for (size_t end : sample_ends_) {
+    std::string stack = "wasm_bench_execute";
+    for (size_t i = begin; i < end; i++) {
+      std::string label = frames_[i] ? frames_[i] : "[unknown]";
+      std::replace(label.begin(), label.end(), ';', ':');
+      stack += ";" + label;
+    }
+    stacks[stack]++;
+    begin = end;
+  }
+  frames_.clear();
+  sample_ends_.clear();
+
+  FILE *out = fopen(path.c_str(), "a");
+  if (!out) {
+    fprintf(stderr, "sm-bench: cannot open profile output '%s'\n", path.c_str());
+    return false;
+  }
+  for (const auto &entry : stacks) {
+    fprintf(out, "%s %zu\n", entry.first.c_str(), entry.second);
+  }
+  fclose(out);
+  return true;
+}
@@ -0,0 +1,53 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <jsapi.h>
+#include <js/ProfilingStack.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// In-process sampling profiler for the execution phase. A background thread
+/// periodically requests an interrupt; the interrupt callback then walks the
+/// wasm and JS frames with `JS::ProfilingFrameIterator` on the JS thread.
+/// Samples are kept as raw label pointers and only folded into strings by
+/// `WriteFoldedStacks`, after the timed window has ended.
+class SamplingProfiler {
+ public:
+  SamplingProfiler(JSContext *cx, uint32_t interval_us);
+  ~SamplingProfiler();
+
+  bool Init();
+
+  /// Start/stop the sampler thread. Must be called outside of the timed
+  /// window; `SetActive` is what gates the sampling itself.
+  void Start();
+  void Stop();
+  void SetActive(bool active) { active_ = active; }
+
+  /// Record one sample. Called from the interrupt callback.
+  void Sample();
+
+  /// Append the collected samples as collapsed stacks, one
+  /// "frame;frame;frame count" line per distinct stack, and clear them.
+  bool WriteFoldedStacks(const std::string &path);
+
+ private:
+  void Run();
+
+  JSContext *cx_;
+  uint32_t interval_us_;
+  js::ProfilingStack profiling_stack_;
+  std::thread thread_;
+  std::atomic<bool> running_;
+  std::atomic<bool> active_;
+
+  // Frames of all samples, outermost first, and the end offset of each
+  // sample in `frames_`.
+  std::vector<const char*> frames_;
+  std::vector<size_t> sample_ends_;
+};
+
+#endif // PROFILER_H
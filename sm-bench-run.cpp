@@ -0,0 +1,969 @@
+// Standalone driver for libsm-bench. Loads the library with dlopen and runs
+// the `wasm_bench_*` entry points the same way sightglass does, timing each
+// phase with CLOCK_MONOTONIC.
+//
+// Usage: sm-bench-run [options] module.wasm
+//   --lib <path>            library to load (default ./libsm-bench.so)
+//   --flags <flags>         execution flags passed to wasm_bench_create
+//   --iterations <n>        runs per configuration (default 10)
+//   --executions <n>        wasm_bench_execute calls per instance (default
+//                           1); execute_ms is per execution
+//   --working-dir <dir>     WASI preopened directory (default .)
+//   --stdin <path>          benchmark stdin
+//   --stdout <path>         benchmark stdout (default /dev/null)
+//   --stderr <path>         benchmark stderr (default /dev/null)
+//   --bounds-check-matrix   run with and without huge memory, each in a
+//                           fresh child process
+//   --context-reuse-matrix  run with fresh contexts and with `reuse-context`,
+//                           each in a fresh child process
+//   --tier-matrix           run baseline, ion and tier in this process, each
+//                           combined with every --matrix-flags entry, and
+//                           print times and output checksums per row
+//   --matrix-flags <flags>  extra flag combination for --tier-matrix
+//                           (repeatable)
+//   --compare <path>        A/B mode: compare --lib (A) against this library
+//                           (B), running the two in randomized interleaved
+//                           order, one fresh child process per run
+//   --seed <n>              random seed for --compare (default: random)
+//   --compile-sweep <param>=<v1>,<v2>,...
+//                           generate a module per value of a wasm-gen
+//                           parameter, compile each and print CSV of
+//                           compile time and memory (no module argument)
+//   --gen <param>=<value>   base wasm-gen parameter for --compile-sweep
+//                           (repeatable)
+//   --suite                 run all given modules with wasm_bench_run_suite,
+//                           once, and print each module's status
+//   --hostcall-suite        generate a module per WASI import and argument
+//                           size that calls it in a tight loop, and print
+//                           ns per call and MB/s (no module argument)
+//   --calls <n>             host calls per run for --hostcall-suite
+//                           (1 to INT32_MAX, default 100000)
+//   --server <socket>       fork server: initialize the engine once, then
+//                           serve run requests on a Unix socket, forking a
+//                           child per request (no module argument)
+//   --connect <socket>      send module.wasm to a fork server and print its
+//                           results
+
+#include <dlfcn.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "sm-bench.h"
+#include "wasm-gen.h"
+
+struct RunnerOptions {
+  std::string lib = "./libsm-bench.so";
+  std::string flags;
+  size_t iterations = 10;
+  uint32_t executions = 1;
+  std::string working_dir = ".";
+  std::string stdin_path;
+  std::string stdout_path = "/dev/null";
+  std::string stderr_path = "/dev/null";
+  bool bounds_check_matrix = false;
+  bool context_reuse_matrix = false;
+  bool suite = false;
+  bool hostcall_suite = false;
+  uint32_t calls = 100000;
+  std::string compile_sweep;
+  WasmGenParams gen_params;
+  bool tier_matrix = false;
+  std::vector<std::string> matrix_flags;
+  std::string compare_lib;
+  uint64_t seed = 0;
+  bool has_seed = false;
+  // Further modules, for `--suite`.
+  std::vector<std::string> suite_paths;
+  std::string server_socket;
+  std::string connect_socket;
+  std::string module_path;
+};
+
+struct BenchLibrary {
+  void *handle = nullptr;
+  decltype(&wasm_bench_create) create = nullptr;
+  decltype(&wasm_bench_free) free = nullptr;
+  decltype(&wasm_bench_compile) compile = nullptr;
+  decltype(&wasm_bench_instantiate) instantiate = nullptr;
+  decltype(&wasm_bench_execute) execute = nullptr;
+  // Optional; missing from older builds of the library.
+  decltype(&wasm_bench_init_engine) init_engine = nullptr;
+  decltype(&wasm_bench_run_suite) run_suite = nullptr;
+  decltype(&wasm_bench_memory_stats) memory_stats = nullptr;
+
+  bool Load(const std::string &path)
+  {
+    handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+      fprintf(stderr, "sm-bench-run: %s\n", dlerror());
+      return false;
+    }
+    create = (decltype(create))dlsym(handle, "wasm_bench_create");
+    free = (decltype(free))dlsym(handle, "wasm_bench_free");
+    compile = (decltype(compile))dlsym(handle, "wasm_bench_compile");
+    instantiate = (decltype(instantiate))dlsym(handle, "wasm_bench_instantiate");
+    execute = (decltype(execute))dlsym(handle, "wasm_bench_execute");
+    init_engine = (decltype(init_engine))dlsym(handle, "wasm_bench_init_engine");
+    run_suite = (decltype(run_suite))dlsym(handle, "wasm_bench_run_suite");
+    memory_stats = (decltype(memory_stats))dlsym(handle, "wasm_bench_memory_stats");
+    if (!create || !free || !compile || !instantiate || !execute) {
+      fprintf(stderr, "sm-bench-run: %s is missing wasm_bench_* entry points\n", path.c_str());
+      return false;
+    }
+    return true;
+  }
+};
+
+struct Timer {
+  uint64_t start_ns = 0;
+  uint64_t elapsed_ns = 0;
+};
+
+static uint64_t NowNs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void TimerStart(void *timer)
+{
+  static_cast<Timer*>(timer)->start_ns = NowNs();
+}
+
+static void TimerEnd(void *timer)
+{
+  Timer *t = static_cast<Timer*>(timer);
+  t->elapsed_ns += NowNs() - t->start_ns;
+}
+
+struct RunResult {
+  bool ok = false;
+  uint64_t compile_ns = 0;
+  uint64_t instantiate_ns = 0;
+  // The median of the run's executions.
+  uint64_t execute_ns = 0;
+};
+
+static WasmBenchConfig MakeConfig(const RunnerOptions &options, const std::string &flags,
+                                  Timer *compilation, Timer *instantiation, Timer *execution)
+{
+  WasmBenchConfig config = {};
+  config.working_dir_ptr = options.working_dir.data();
+  config.working_dir_len = options.working_dir.size();
+  config.stdout_path_ptr = options.stdout_path.data();
+  config.stdout_path_len = options.stdout_path.size();
+  config.stderr_path_ptr = options.stderr_path.data();
+  config.stderr_path_len = options.stderr_path.size();
+  if (!options.stdin_path.empty()) {
+    config.stdin_path_ptr = options.stdin_path.data();
+    config.stdin_path_len = options.stdin_path.size();
+  }
+  config.compilation_timer = compilation;
+  config.compilation_start = TimerStart;
+  config.compilation_end = TimerEnd;
+  config.instantiation_timer = instantiation;
+  config.instantiation_start = TimerStart;
+  config.instantiation_end = TimerEnd;
+  config.execution_timer = execution;
+  config.execution_start = TimerStart;
+  config.execution_end = TimerEnd;
+  if (!flags.empty()) {
+    config.execution_flags_ptr = flags.data();
+    config.execution_flags_len = flags.size();
+  }
+  return config;
+}
+
+static uint64_t Median(std::vector<uint64_t> values)
+{
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+static RunResult RunOnce(const BenchLibrary &lib, const RunnerOptions &options,
+                         const std::string &flags, const std::vector<char> &wasm)
+{
+  Timer compilation, instantiation, execution;
+  WasmBenchConfig config = MakeConfig(options, flags, &compilation, &instantiation, &execution);
+
+  RunResult result;
+  void *bench = nullptr;
+  if (lib.create(config, &bench) != BENCH_EXIT_OK) return result;
+  bool ok = lib.compile(bench, wasm.data(), wasm.size()) == BENCH_EXIT_OK &&
+            lib.instantiate(bench) == BENCH_EXIT_OK;
+  std::vector<uint64_t> executions;
+  for (uint32_t i = 0; ok && i < options.executions; i++) {
+    uint64_t before_ns = execution.elapsed_ns;
+    ok = lib.execute(bench) == BENCH_EXIT_OK;
+    executions.push_back(execution.elapsed_ns - before_ns);
+  }
+  ok = lib.free(bench) == BENCH_EXIT_OK && ok;
+
+  result.ok = ok;
+  result.compile_ns = compilation.elapsed_ns;
+  result.instantiate_ns = instantiation.elapsed_ns;
+  result.execute_ns = Median(executions);
+  return result;
+}
+
+static double MedianMs(const std::vector<uint64_t> &values)
+{
+  return Median(values) / 1e6;
+}
+
+static void PrintHeader()
+{
+  printf("%-24s %12s %16s %12s\n", "config", "compile_ms", "instantiate_ms", "execute_ms");
+}
+
+// Runs `options.iterations` iterations of `flags` and prints one row of
+// median phase times.
+static bool RunConfig(const BenchLibrary &lib, const RunnerOptions &options,
+                      const std::string &label, const std::string &flags,
+                      const std::vector<char> &wasm)
+{
+  std::vector<uint64_t> compile, instantiate, execute;
+  for (size_t i = 0; i < options.iterations; i++) {
+    RunResult result = RunOnce(lib, options, flags, wasm);
+    if (!result.ok) {
+      fprintf(stderr, "sm-bench-run: %s failed on iteration %zu\n", label.c_str(), i);
+      return false;
+    }
+    compile.push_back(result.compile_ns);
+    instantiate.push_back(result.instantiate_ns);
+    execute.push_back(result.execute_ns);
+  }
+  printf("%-24s %12.3f %16.3f %12.3f\n", label.c_str(), MedianMs(compile),
+         MedianMs(instantiate), MedianMs(execute));
+  fflush(stdout);
+  return true;
+}
+
+// Process-wide engine settings are fixed at the library's first
+// `wasm_bench_create`, so each configuration gets its own child process
+// that loads the library from scratch.
+static bool RunInChild(const RunnerOptions &options, const std::string &label,
+                       const std::string &flags, const std::vector<char> &wasm)
+{
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("sm-bench-run: fork");
+    return false;
+  }
+  if (pid == 0) {
+    BenchLibrary lib;
+    if (!lib.Load(options.lib)) _exit(1);
+    _exit(RunConfig(lib, options, label, flags, wasm) ? 0 : 1);
+  }
+  int status = 0;
+  if (waitpid(pid, &status, 0) < 0) return false;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static std::string JoinFlags(const std::string &a, const std::string &b)
+{
+  if (a.empty()) return b;
+  if (b.empty()) return a;
+  return a + " " + b;
+}
+
+static bool ReadFile(const std::string &path, std::vector<char> *out)
+{
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    fprintf(stderr, "sm-bench-run: cannot read '%s'\n", path.c_str());
+    return false;
+  }
+  out->assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  return true;
+}
+
+// FNV-1a of the file's contents.
+static uint64_t FileChecksum(const std::string &path)
+{
+  std::ifstream in(path, std::ios::binary);
+  uint64_t hash = 0xcbf29ce484222325ull;
+  char buf[4096];
+  while (in.read(buf, sizeof(buf)) || in.gcount() > 0) {
+    for (std::streamsize i = 0; i < in.gcount(); i++) {
+      hash = (hash ^ (uint8_t)buf[i]) * 0x100000001b3ull;
+    }
+  }
+  return hash;
+}
+
+// Runs the module under every wasm tier, crossed with each extra flag
+// combination, in this process and with the same input files. Each row
+// shows median phase times and a checksum of the benchmark's stdout, so a
+// tier that computes something different stands out.
+static int RunTierMatrix(const RunnerOptions &options, const std::vector<char> &wasm)
+{
+  BenchLibrary lib;
+  if (!lib.Load(options.lib)) return 1;
+
+  // The output has to land somewhere to be checksummed.
+  RunnerOptions run = options;
+  char temp_path[] = "/tmp/sm-bench-run-stdout-XXXXXX";
+  bool temp_stdout = run.stdout_path == "/dev/null";
+  if (temp_stdout) {
+    int fd = mkstemp(temp_path);
+    if (fd < 0) {
+      perror("sm-bench-run: mkstemp");
+      return 1;
+    }
+    close(fd);
+    run.stdout_path = temp_path;
+  }
+
+  static const char *tiers[] = {"baseline", "ion", "tier"};
+  std::vector<std::string> extras = options.matrix_flags;
+  if (extras.empty()) extras.push_back("");
+
+  printf("%-32s %12s %16s %12s  %s\n", "config", "compile_ms", "instantiate_ms", "execute_ms",
+         "stdout_checksum");
+  bool ok = true;
+  std::vector<uint64_t> checksums;
+  for (const std::string &extra : extras) {
+    for (const char *tier : tiers) {
+      std::string label = JoinFlags(tier, extra);
+      std::string flags = JoinFlags(options.flags, label);
+      std::vector<uint64_t> compile, instantiate, execute;
+      uint64_t checksum = 0;
+      bool stable = true;
+      for (size_t i = 0; i < run.iterations && ok; i++) {
+        RunResult result = RunOnce(lib, run, flags, wasm);
+        if (!result.ok) {
+          fprintf(stderr, "sm-bench-run: %s failed on iteration %zu\n", label.c_str(), i);
+          ok = false;
+          break;
+        }
+        compile.push_back(result.compile_ns);
+        instantiate.push_back(result.instantiate_ns);
+        execute.push_back(result.execute_ns);
+        uint64_t current = FileChecksum(run.stdout_path);
+        if (i > 0 && current != checksum) stable = false;
+        checksum = current;
+      }
+      if (!ok) break;
+      checksums.push_back(checksum);
+      printf("%-32s %12.3f %16.3f %12.3f  %016llx%s\n", label.c_str(), MedianMs(compile),
+             MedianMs(instantiate), MedianMs(execute), (unsigned long long)checksum,
+             stable ? "" : " (varies between iterations)");
+      fflush(stdout);
+    }
+    if (!ok) break;
+  }
+  if (temp_stdout) unlink(temp_path);
+  if (!ok) return 1;
+
+  bool same = std::all_of(checksums.begin(), checksums.end(),
+                          [&](uint64_t c) { return c == checksums[0]; });
+  printf("outputs: %s\n", same ? "identical" : "DIFFER");
+  return same ? 0 : 1;
+}
+
+// Runs one iteration of `lib_path` in a fresh child process and passes the
+// result back through a pipe, so that two builds of the library, possibly
+// linked against the same mozjs, never share a process.
+static bool RunOnceInChild(const RunnerOptions &options, const std::string &lib_path,
+                           const std::vector<char> &wasm, RunResult *out)
+{
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("sm-bench-run: pipe");
+    return false;
+  }
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("sm-bench-run: fork");
+    return false;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    BenchLibrary lib;
+    RunResult result;
+    if (lib.Load(lib_path)) result = RunOnce(lib, options, options.flags, wasm);
+    _exit(write(fds[1], &result, sizeof(result)) == sizeof(result) ? 0 : 1);
+  }
+  close(fds[1]);
+  RunResult result;
+  bool ok = read(fds[0], &result, sizeof(result)) == sizeof(result);
+  close(fds[0]);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  *out = result;
+  return ok && result.ok;
+}
+
+static double MedianOf(std::vector<double> values)
+{
+  std::sort(values.begin(), values.end());
+  size_t n = values.size();
+  return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+struct Comparison {
+  double a_ms;
+  double b_ms;
+  // Relative change of the median, B over A, with a 95% bootstrap interval.
+  double delta;
+  double ci_low;
+  double ci_high;
+};
+
+static Comparison Compare(const std::vector<double> &a, const std::vector<double> &b,
+                          std::mt19937_64 &rng)
+{
+  const int resamples = 2000;
+  Comparison c;
+  c.a_ms = MedianOf(a);
+  c.b_ms = MedianOf(b);
+  c.delta = c.a_ms > 0 ? c.b_ms / c.a_ms - 1 : 0;
+
+  std::vector<double> deltas;
+  std::vector<double> sample_a(a.size()), sample_b(b.size());
+  std::uniform_int_distribution<size_t> pick_a(0, a.size() - 1), pick_b(0, b.size() - 1);
+  for (int i = 0; i < resamples; i++) {
+    for (double &x : sample_a) x = a[pick_a(rng)];
+    for (double &x : sample_b) x = b[pick_b(rng)];
+    double median_a = MedianOf(sample_a);
+    if (median_a > 0) deltas.push_back(MedianOf(sample_b) / median_a - 1);
+  }
+  std::sort(deltas.begin(), deltas.end());
+  c.ci_low = deltas.empty() ? 0 : deltas[deltas.size() * 25 / 1000];
+  c.ci_high = deltas.empty() ? 0 : deltas[deltas.size() * 975 / 1000];
+  return c;
+}
+
+// A/B mode: every round runs A and B once each, in random order, so that
+// drift over time (thermal, frequency, background load) hits both builds
+// alike. Returns 3 if any phase regressed significantly.
+static int RunCompare(const RunnerOptions &options, const std::vector<char> &wasm)
+{
+  std::mt19937_64 rng(options.has_seed ? options.seed : std::random_device()());
+  std::vector<double> a[3], b[3];
+  for (size_t round = 0; round < options.iterations; round++) {
+    bool b_first = rng() & 1;
+    for (int turn = 0; turn < 2; turn++) {
+      bool is_b = (turn == 0) == b_first;
+      RunResult result;
+      if (!RunOnceInChild(options, is_b ? options.compare_lib : options.lib, wasm, &result)) {
+        fprintf(stderr, "sm-bench-run: %s failed in round %zu\n", is_b ? "B" : "A", round);
+        return 1;
+      }
+      std::vector<double> *phases = is_b ? b : a;
+      phases[0].push_back(result.compile_ns / 1e6);
+      phases[1].push_back(result.instantiate_ns / 1e6);
+      phases[2].push_back(result.execute_ns / 1e6);
+    }
+  }
+
+  printf("A: %s\nB: %s\nrounds: %zu\n", options.lib.c_str(), options.compare_lib.c_str(),
+         options.iterations);
+  printf("%-12s %12s %12s %9s %21s  %s\n", "phase", "A_ms", "B_ms", "delta", "95% CI", "verdict");
+  static const char *names[3] = {"compile", "instantiate", "execute"};
+  bool regressed = false;
+  for (int phase = 0; phase < 3; phase++) {
+    Comparison c = Compare(a[phase], b[phase], rng);
+    // Significant when the interval excludes zero change.
+    const char *verdict = "no change";
+    if (c.ci_low > 0) {
+      verdict = "REGRESSION";
+      regressed = true;
+    } else if (c.ci_high < 0) {
+      verdict = "improvement";
+    }
+    printf("%-12s %12.3f %12.3f %+8.2f%% [%+8.2f%%, %+8.2f%%]  %s\n", names[phase],
+           c.a_ms, c.b_ms, c.delta * 100, c.ci_low * 100, c.ci_high * 100, verdict);
+  }
+  return regressed ? 3 : 0;
+}
+
+// Creates a bench, compiles `wasm` and records the compile time and the
+// memory footprint right after compilation.
+static bool CompileOnce(const BenchLibrary &lib, const RunnerOptions &options,
+                        const std::vector<char> &wasm, uint64_t *compile_ns,
+                        WasmBenchMemoryStats *stats)
+{
+  Timer compilation, instantiation, execution;
+  WasmBenchConfig config = MakeConfig(options, options.flags, &compilation, &instantiation,
+                                      &execution);
+  void *bench = nullptr;
+  if (lib.create(config, &bench) != BENCH_EXIT_OK) return false;
+  bool ok = lib.compile(bench, wasm.data(), wasm.size()) == BENCH_EXIT_OK;
+  *stats = {};
+  if (ok && lib.memory_stats) lib.memory_stats(bench, stats);
+  ok = lib.free(bench) == BENCH_EXIT_OK && ok;
+  *compile_ns = compilation.elapsed_ns;
+  return ok;
+}
+
+// Compiles a generated module per value of one wasm-gen parameter, all other
+// parameters fixed, and prints CSV ready for plotting. Memory columns are
+// the medians taken right after compilation; peak RSS is process-wide and
+// only ever grows.
+static int RunCompileSweep(const RunnerOptions &options)
+{
+  size_t eq = options.compile_sweep.find('=');
+  if (eq == std::string::npos) {
+    fprintf(stderr, "sm-bench-run: --compile-sweep expects <param>=<v1>,<v2>,...\n");
+    return 2;
+  }
+  std::string param = options.compile_sweep.substr(0, eq);
+  std::vector<std::string> values;
+  std::string list = options.compile_sweep.substr(eq + 1);
+  for (size_t start = 0; start <= list.size();) {
+    size_t comma = list.find(',', start);
+    if (comma == std::string::npos) comma = list.size();
+    values.push_back(list.substr(start, comma - start));
+    start = comma + 1;
+  }
+
+  BenchLibrary lib;
+  if (!lib.Load(options.lib)) return 1;
+
+  printf("param,value,module_bytes,compile_ms,executable_bytes,js_heap_bytes,rss_bytes,peak_rss_bytes\n");
+  for (const std::string &value : values) {
+    WasmGenParams params = options.gen_params;
+    if (!SetWasmGenParam(param, value, &params)) return 2;
+    std::vector<uint8_t> generated;
+    GenerateWasmModule(params, &generated);
+    std::vector<char> wasm(generated.begin(), generated.end());
+
+    std::vector<uint64_t> compile, executable, js_heap, rss;
+    WasmBenchMemoryStats stats;
+    for (size_t i = 0; i < options.iterations; i++) {
+      uint64_t compile_ns;
+      if (!CompileOnce(lib, options, wasm, &compile_ns, &stats)) {
+        fprintf(stderr, "sm-bench-run: %s=%s failed to compile\n", param.c_str(), value.c_str());
+        return 1;
+      }
+      compile.push_back(compile_ns);
+      executable.push_back(stats.executable_bytes);
+      js_heap.push_back(stats.js_heap_bytes);
+      rss.push_back(stats.rss_bytes);
+    }
+    printf("%s,%s,%zu,%.3f,%llu,%llu,%llu,%llu\n", param.c_str(), value.c_str(), wasm.size(),
+           MedianMs(compile), (unsigned long long)Median(executable),
+           (unsigned long long)Median(js_heap), (unsigned long long)Median(rss),
+           (unsigned long long)stats.peak_rss_bytes);
+    fflush(stdout);
+  }
+  return 0;
+}
+
+// Runs every module once through `wasm_bench_run_suite`. Phase timers are
+// summed over the suite.
+static int RunSuite(const RunnerOptions &options)
+{
+  BenchLibrary lib;
+  if (!lib.Load(options.lib)) return 1;
+  if (!lib.run_suite) {
+    fprintf(stderr, "sm-bench-run: %s has no wasm_bench_run_suite\n", options.lib.c_str());
+    return 1;
+  }
+
+  std::vector<std::string> paths = {options.module_path};
+  paths.insert(paths.end(), options.suite_paths.begin(), options.suite_paths.end());
+  std::vector<std::vector<char>> bytes(paths.size());
+  std::vector<WasmBenchSuiteModule> modules(paths.size());
+  for (size_t i = 0; i < paths.size(); i++) {
+    if (!ReadFile(paths[i], &bytes[i])) return 1;
+    modules[i] = {};
+    modules[i].wasm_bytes = bytes[i].data();
+    modules[i].wasm_bytes_length = bytes[i].size();
+  }
+
+  Timer compilation, instantiation, execution;
+  WasmBenchConfig config = MakeConfig(options, options.flags, &compilation, &instantiation,
+                                      &execution);
+  std::vector<ExitCode> results(paths.size());
+  uint64_t start_ns = NowNs();
+  ExitCode status = lib.run_suite(config, modules.data(), modules.size(), results.data());
+  double wall_ms = (NowNs() - start_ns) / 1e6;
+
+  for (size_t i = 0; i < paths.size(); i++) {
+    printf("%-8s %s\n", results[i] == BENCH_EXIT_OK ? "ok" : "FAILED", paths[i].c_str());
+  }
+  printf("modules=%zu wall_ms=%.3f compile_ms=%.3f instantiate_ms=%.3f execute_ms=%.3f\n",
+         paths.size(), wall_ms, compilation.elapsed_ns / 1e6, instantiation.elapsed_ns / 1e6,
+         execution.elapsed_ns / 1e6);
+  return status == BENCH_EXIT_OK ? 0 : 1;
+}
+
+// Host-call microbenchmarks: each case is a generated module whose `_start`
+// makes `options.calls` calls to one WASI import inside the execution timer.
+// The loop around the call is a handful of instructions, so the time per
+// call is essentially the wasm-to-host transition plus the import's work.
+static int RunHostCallSuite(const RunnerOptions &options)
+{
+  static const uint32_t sizes[] = {1, 64, 4096, 65536};
+  std::vector<HostCallParams> cases;
+  for (const std::string &import : HostCallImports()) {
+    HostCallParams params;
+    params.import = import;
+    params.calls = options.calls;
+    if (!HostCallIsSized(import)) {
+      params.size = 0;
+      cases.push_back(params);
+      continue;
+    }
+    for (uint32_t size : sizes) {
+      params.size = size;
+      cases.push_back(params);
+    }
+  }
+
+  BenchLibrary lib;
+  if (!lib.Load(options.lib)) return 1;
+
+  printf("%-20s %8s %10s %12s %12s\n", "import", "size", "calls", "ns_per_call", "mb_per_s");
+  bool ok = true;
+  for (const HostCallParams &params : cases) {
+    std::vector<uint8_t> generated;
+    if (!GenerateHostCallModule(params, &generated)) return 1;
+    std::vector<char> wasm(generated.begin(), generated.end());
+
+    std::vector<uint64_t> execute;
+    for (size_t i = 0; i < options.iterations; i++) {
+      RunResult result = RunOnce(lib, options, options.flags, wasm);
+      if (!result.ok) break;
+      execute.push_back(result.execute_ns);
+    }
+    if (execute.size() != options.iterations) {
+      fprintf(stderr, "sm-bench-run: %s size=%u failed\n", params.import.c_str(), params.size);
+      ok = false;
+      continue;
+    }
+
+    double ns = (double)Median(execute);
+    double ns_per_call = params.calls ? ns / params.calls : 0;
+    if (params.size) {
+      double mb_per_s = ns ? (double)params.size * params.calls / ns * 1e3 : 0;
+      printf("%-20s %8u %10u %12.1f %12.1f\n", params.import.c_str(), params.size,
+             params.calls, ns_per_call, mb_per_s);
+    } else {
+      printf("%-20s %8s %10u %12.1f %12s\n", params.import.c_str(), "-", params.calls,
+             ns_per_call, "-");
+    }
+    fflush(stdout);
+  }
+  return ok ? 0 : 1;
+}
+
+static bool UnixSocketAddress(const std::string &path, struct sockaddr_un *addr)
+{
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr->sun_path)) {
+    fprintf(stderr, "sm-bench-run: socket path too long: '%s'\n", path.c_str());
+    return false;
+  }
+  memcpy(addr->sun_path, path.c_str(), path.size());
+  return true;
+}
+
+// Reads one '\n'-terminated line from `fd`.
+static bool ReadLine(int fd, std::string *out)
+{
+  out->clear();
+  char c;
+  while (read(fd, &c, 1) == 1) {
+    if (c == '\n') return true;
+    out->push_back(c);
+  }
+  return false;
+}
+
+static void WriteString(int fd, const std::string &s)
+{
+  size_t written = 0;
+  while (written < s.size()) {
+    ssize_t n = write(fd, s.data() + written, s.size() - written);
+    if (n <= 0) return;
+    written += n;
+  }
+}
+
+// Fork server. The parent initializes the engine, then reads each request's
+// module and forks a child for it; the child inherits the initialized engine
+// copy-on-write and runs `options.iterations` iterations with its output
+// sent to the client. Contexts, and with them compiled code and the
+// engine's helper threads, only ever exist in children: threads don't
+// survive fork. Requests are served one at a time so runs don't overlap.
+static int RunServer(const RunnerOptions &options)
+{
+  BenchLibrary lib;
+  if (!lib.Load(options.lib)) return 1;
+  uint64_t start_ns = NowNs();
+  if (lib.init_engine &&
+      lib.init_engine(options.flags.data(), options.flags.size()) != BENCH_EXIT_OK) {
+    fprintf(stderr, "sm-bench-run: engine initialization failed\n");
+    return 1;
+  }
+  double engine_init_ms = (NowNs() - start_ns) / 1e6;
+
+  struct sockaddr_un addr;
+  if (!UnixSocketAddress(options.server_socket, &addr)) return 1;
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    perror("sm-bench-run: socket");
+    return 1;
+  }
+  unlink(options.server_socket.c_str());
+  if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 16) != 0) {
+    perror("sm-bench-run: bind");
+    return 1;
+  }
+  fprintf(stderr, "sm-bench-run: serving on %s, engine_init_ms=%.3f\n",
+          options.server_socket.c_str(), engine_init_ms);
+
+  // A client going away mid-response must not kill the server.
+  signal(SIGPIPE, SIG_IGN);
+  for (;;) {
+    int conn = accept(listener, nullptr, nullptr);
+    if (conn < 0) {
+      perror("sm-bench-run: accept");
+      continue;
+    }
+    std::string path;
+    if (!ReadLine(conn, &path)) {
+      close(conn);
+      continue;
+    }
+    // Read per request, outside `request_ms`, so a rebuilt module is never
+    // served stale.
+    std::vector<char> wasm;
+    if (!ReadFile(path, &wasm)) {
+      WriteString(conn, "status=failed\n");
+      close(conn);
+      continue;
+    }
+
+    uint64_t request_start_ns = NowNs();
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(listener);
+      dup2(conn, STDOUT_FILENO);
+      close(conn);
+      PrintHeader();
+      bool ok = RunConfig(lib, options, path, options.flags, wasm);
+      fflush(stdout);
+      _exit(ok ? 0 : 1);
+    }
+    int status = 0;
+    bool ok = pid > 0 && waitpid(pid, &status, 0) == pid &&
+              WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (pid < 0) perror("sm-bench-run: fork");
+    char line[128];
+    snprintf(line, sizeof(line), "request_ms=%.3f engine_init_ms=%.3f status=%s\n",
+             (NowNs() - request_start_ns) / 1e6, engine_init_ms, ok ? "ok" : "failed");
+    WriteString(conn, line);
+    close(conn);
+  }
+}
+
+// Client side of `--server`: sends the module path and copies the response
+// to stdout.
+static int RunClient(const RunnerOptions &options)
+{
+  char resolved[PATH_MAX];
+  if (!realpath(options.module_path.c_str(), resolved)) {
+    fprintf(stderr, "sm-bench-run: cannot resolve '%s'\n", options.module_path.c_str());
+    return 1;
+  }
+  struct sockaddr_un addr;
+  if (!UnixSocketAddress(options.connect_socket, &addr)) return 1;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    perror("sm-bench-run: connect");
+    return 1;
+  }
+  WriteString(fd, std::string(resolved) + "\n");
+
+  std::string response;
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    response.append(buf, n);
+  }
+  close(fd);
+  fputs(response.c_str(), stdout);
+  return response.find("status=ok") != std::string::npos ? 0 : 1;
+}
+
+// Parses a positive count that fits in an int32.
+static bool ParseCount(const std::string &arg, const std::string &value, uint32_t *out)
+{
+  char *end = nullptr;
+  unsigned long long n = strtoull(value.c_str(), &end, 10);
+  if (end == value.c_str() || *end != '\0' || n == 0 || n > INT32_MAX) {
+    fprintf(stderr, "sm-bench-run: %s must be between 1 and %d: '%s'\n", arg.c_str(),
+            INT32_MAX, value.c_str());
+    return false;
+  }
+  *out = (uint32_t)n;
+  return true;
+}
+
+static bool ParseArgs(int argc, char **argv, RunnerOptions *out)
+{
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto value = [&](std::string *dst) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "sm-bench-run: missing value for %s\n", arg.c_str());
+        return false;
+      }
+      *dst = argv[++i];
+      return true;
+    };
+    if (arg == "--lib") {
+      if (!value(&out->lib)) return false;
+    } else if (arg == "--flags") {
+      if (!value(&out->flags)) return false;
+    } else if (arg == "--iterations") {
+      std::string n;
+      uint32_t iterations;
+      if (!value(&n) || !ParseCount(arg, n, &iterations)) return false;
+      out->iterations = iterations;
+    } else if (arg == "--executions") {
+      std::string n;
+      if (!value(&n) || !ParseCount(arg, n, &out->executions)) return false;
+    } else if (arg == "--working-dir") {
+      if (!value(&out->working_dir)) return false;
+    } else if (arg == "--stdin") {
+      if (!value(&out->stdin_path)) return false;
+    } else if (arg == "--stdout") {
+      if (!value(&out->stdout_path)) return false;
+    } else if (arg == "--stderr") {
+      if (!value(&out->stderr_path)) return false;
+    } else if (arg == "--bounds-check-matrix") {
+      out->bounds_check_matrix = true;
+    } else if (arg == "--context-reuse-matrix") {
+      out->context_reuse_matrix = true;
+    } else if (arg == "--tier-matrix") {
+      out->tier_matrix = true;
+    } else if (arg == "--matrix-flags") {
+      std::string flags;
+      if (!value(&flags)) return false;
+      out->matrix_flags.push_back(flags);
+    } else if (arg == "--compare") {
+      if (!value(&out->compare_lib)) return false;
+    } else if (arg == "--seed") {
+      std::string n;
+      if (!value(&n)) return false;
+      out->seed = strtoull(n.c_str(), nullptr, 10);
+      out->has_seed = true;
+    } else if (arg == "--compile-sweep") {
+      if (!value(&out->compile_sweep)) return false;
+    } else if (arg == "--gen") {
+      std::string param;
+      if (!value(&param)) return false;
+      size_t eq = param.find('=');
+      if (eq == std::string::npos ||
+          !SetWasmGenParam(param.substr(0, eq), param.substr(eq + 1), &out->gen_params)) {
+        fprintf(stderr, "sm-bench-run: invalid --gen '%s'\n", param.c_str());
+        return false;
+      }
+    } else if (arg == "--suite") {
+      out->suite = true;
+    } else if (arg == "--hostcall-suite") {
+      out->hostcall_suite = true;
+    } else if (arg == "--calls") {
+      std::string n;
+      if (!value(&n) || !ParseCount(arg, n, &out->calls)) return false;
+    } else if (arg == "--server") {
+      if (!value(&out->server_socket)) return false;
+    } else if (arg == "--connect") {
+      if (!value(&out->connect_socket)) return false;
+    } else if (arg.compare(0, 2, "--") != 0 && out->suite && !out->module_path.empty()) {
+      out->suite_paths.push_back(arg);
+    } else if (arg.compare(0, 2, "--") == 0 || !out->module_path.empty()) {
+      fprintf(stderr, "sm-bench-run: unexpected argument '%s'\n", arg.c_str());
+      return false;
+    } else {
+      out->module_path = arg;
+    }
+  }
+  if (!out->server_socket.empty() || !out->compile_sweep.empty() || out->hostcall_suite) {
+    if (!out->module_path.empty()) {
+      fprintf(stderr, "sm-bench-run: --server, --compile-sweep and --hostcall-suite take no module\n");
+      return false;
+    }
+    return true;
+  }
+  if (out->module_path.empty()) {
+    fprintf(stderr, "usage: sm-bench-run [options] module.wasm\n"
+                    "       sm-bench-run [options] --server <socket>\n");
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  RunnerOptions options;
+  if (!ParseArgs(argc, argv, &options)) return 2;
+  if (!options.server_socket.empty()) return RunServer(options);
+  if (!options.compile_sweep.empty()) return RunCompileSweep(options);
+  if (options.hostcall_suite) return RunHostCallSuite(options);
+  if (!options.connect_socket.empty()) return RunClient(options);
+  if (options.suite) return RunSuite(options);
+
+  std::vector<char> wasm;
+  if (!ReadFile(options.module_path, &wasm)) return 1;
+
+  if (!options.compare_lib.empty()) {
+    if (options.iterations < 2) {
+      fprintf(stderr, "sm-bench-run: --compare needs at least 2 iterations\n");
+      return 2;
+    }
+    return RunCompare(options, wasm);
+  }
+
+  if (options.tier_matrix) return RunTierMatrix(options, wasm);
+
+  PrintHeader();
+  fflush(stdout);
+
+  if (options.bounds_check_matrix) {
+    bool ok = RunInChild(options, "huge-memory", options.flags, wasm);
+    ok = RunInChild(options, "explicit-bounds-checks",
+                    JoinFlags(options.flags, "no-huge-memory"), wasm) && ok;
+    return ok ? 0 : 1;
+  }
+
+  if (options.context_reuse_matrix) {
+    // The first iteration of "reused" still creates its context; the median
+    // reflects the reused ones.
+    bool ok = RunInChild(options, "fresh-context", options.flags, wasm);
+    ok = RunInChild(options, "reused-context",
+                    JoinFlags(options.flags, "reuse-context"), wasm) && ok;
+    return ok ? 0 : 1;
+  }
+
+  BenchLibrary lib;
+  if (!lib.Load(options.lib)) return 1;
+  return RunConfig(lib, options, options.flags.empty() ? "default" : options.flags,
+                   options.flags, wasm) ? 0 : 1;
+}
@@ -9,18 +9,92 @@
 #include <js/SourceText.h>
 #include <js/WasmModule.h>
 #include <js/ArrayBuffer.h>
+#include <js/StructuredClone.h>
+#include <js/BigInt.h>
+#include <js/Array.h>
+#include <js/GCAPI.h>
+#include <js/Conversions.h>
 
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <fstream>
+#include <future>
+#include <thread>
 
 #include "sm-bench.h"
 #include "wasi-imports.h"
+#include "wasi-api.h"
 #include "bench-state.h"
+#include "bench-options.h"
+#include "memory-stats.h"
+
+// Process-wide engine state. JS_Init is deferred until the first
+// `wasm_bench_create` so that execution flags can configure the engine
+// before it starts.
+static bool engine_initialized = false;
+static BenchOptions engine_options;
+
+static bool EnsureEngineInitialized(const BenchOptions &options)
+{
+  if (engine_initialized) {
+    if (options.perf != engine_options.perf) {
+      fprintf(stderr, "sm-bench: perf mode cannot change after engine initialization\n");
+      return false;
+    }
+    if (options.no_huge_memory != engine_options.no_huge_memory) {
+      fprintf(stderr, "sm-bench: no-huge-memory cannot change after engine initialization\n");
+      return false;
+    }
+    return true;
+  }
+
+  if (!options.perf.empty()) {
+    // Read by SpiderMonkey's perf spewer, which names wasm functions using
+    // the module's name section. Requires mozjs configured with
+    // --enable-perf.
+    setenv("IONPERF", options.perf.c_str(), 1);
+  }
+
+  if (options.no_huge_memory && !JS::DisableWasmHugeMemory()) {
+    fprintf(stderr, "sm-bench: cannot disable wasm huge memory\n");
+    return false;
+  }
 
+  if (!JS_Init()) {
+    fprintf(stderr, "JS engine is not initialized\n");
+    return false;
+  }
+  engine_initialized = true;
+  engine_options = options;
+  return true;
+}
 
-static JSObject* CreateGlobal(JSContext* cx) {
+// Huge memory is only available on 64-bit platforms; everywhere else wasm
+// memory accesses are always bounds checked. The engine can still fall back
+// to explicit checks, e.g. under a small RLIMIT_AS; the memory report gives
+// the strategy actually observed.
+static const char* RequestedBoundsChecks()
+{
+#if defined(__x86_64__) || defined(__aarch64__)
+  if (!engine_options.no_huge_memory) return "huge-memory";
+#endif
+  return "explicit";
+}
+
+
+// Standard classes, `WebAssembly` included, are resolved lazily on first use
+// by the default class ops. The minimal global only skips the debugger's
+// new-global hook.
+static JSObject* CreateGlobal(JSContext* cx, bool minimal = false) {
   JS::RealmOptions options;
+  // Needed for modules that import a shared memory.
+  options.creationOptions().setSharedMemoryAndAtomicsEnabled(true);
 
   static JSClass SmBenchGlobal = {
       "SmBenchGlobal",
@@ -28,9 +102,34 @@ static JSObject* CreateGlobal(JSContext* cx) {
       &JS::DefaultGlobalClassOps};
 
   return JS_NewGlobalObject(cx, &SmBenchGlobal, nullptr,
-                            JS::FireOnNewGlobalHook, options);
+                            minimal ? JS::DontFireOnNewGlobalHook : JS::FireOnNewGlobalHook,
+                            options);
 }
 
+// Self-hosted stencil written by the first `fast-create` context of the
+// process and decoded by later ones instead of parsing the self-hosted
+// sources again. Contexts are created on several threads (suite compiler,
+// wasi-threads), so it is written once, under the mutex, and never changes
+// afterwards.
+static std::mutex self_hosted_cache_mutex;
+static std::vector<uint8_t> self_hosted_cache;
+
+static bool WriteSelfHostedCache(JSContext *cx, JS::SelfHostedCache buffer)
+{
+  std::lock_guard<std::mutex> lock(self_hosted_cache_mutex);
+  if (self_hosted_cache.empty()) {
+    self_hosted_cache.assign(buffer.begin(), buffer.end());
+  }
+  return true;
+}
+
+/// Durations of the steps of `NewBenchContext`.
+struct ContextTimings {
+  uint64_t new_context_ns = 0;
+  uint64_t self_hosted_ns = 0;
+  bool self_hosted_cached = false;
+};
+
 static void ReportAndClearException(JSContext* cx) {
   JS::ExceptionStack stack(cx);
   if (!JS::StealPendingExceptionStack(cx, &stack)) {
@@ -47,6 +146,219 @@ static void ReportAndClearException(JSContext* cx) {
   JS::PrintError(stderr, report, true);
 }
 
+static void StopWasiThreads(BenchState *bench);
+static void JoinWasiThreads(BenchState *bench);
+static JSObject* BuildImports(JSContext *cx, bool mainThread = true);
+
+static void SetWasmTiers(JSContext *cx, const BenchOptions &options)
+{
+  JS::ContextOptionsRef(cx)
+    .setWasm(true)
+    .setWasmBaseline(options.wasm_baseline)
+    .setWasmIon(options.wasm_ion);
+}
+
+// A context and global returned by `wasm_bench_free` with `reuse-context`
+// or `fast-teardown`.
+struct PooledContext {
+  JSContext *cx;
+  std::unique_ptr<JS::PersistentRootedObject> global;
+  // Settings fixed at context creation.
+  uint32_t heap_max_bytes;
+  uint32_t nursery_bytes;
+  // Left by `fast-teardown` without collecting the bench's garbage.
+  bool abandoned;
+};
+
+// Abandoned contexts left alive at thread exit or library unload.
+// JS_ShutDown must not run while they exist, so the engine is left for
+// process exit to clean up.
+static std::atomic<size_t> leaked_contexts{0};
+
+// Contexts can only be used on the thread that created them, and a thread
+// can have only one, so the pool holds at most one context per thread. It is
+// released when the thread exits, or by `bench_fini` for the thread that
+// unloads the library.
+struct ContextPool {
+  std::optional<PooledContext> context;
+
+  ~ContextPool() { Release(); }
+
+  void Drain()
+  {
+    if (!context) return;
+    context->global.reset();
+    JS_DestroyContext(context->cx);
+    context.reset();
+  }
+
+  // Like `Drain`, but an abandoned context is leaked rather than paying for
+  // its destruction.
+  void Release()
+  {
+    if (context && context->abandoned) {
+      (void)context->global.release();
+      context.reset();
+      leaked_contexts++;
+    }
+    Drain();
+  }
+};
+
+static thread_local ContextPool context_pool;
+
+// Takes the pooled context if `options` has `reuse-context` and the same
+// heap settings it was created with. Otherwise the pooled context, e.g. one
+// abandoned by `fast-teardown`, is destroyed, as the thread can't create a
+// new one while it exists. Called before the create timings start.
+static std::optional<PooledContext> TakePooledContext(const BenchOptions &options)
+{
+  std::optional<PooledContext> &pooled = context_pool.context;
+  if (pooled && options.reuse_context &&
+      pooled->heap_max_bytes == options.heap_max_bytes &&
+      pooled->nursery_bytes == options.nursery_bytes) {
+    std::optional<PooledContext> entry = std::move(pooled);
+    pooled.reset();
+    if (entry->abandoned) {
+      // `wasm_bench_free` skipped the collection.
+      JS::PrepareForFullGC(entry->cx);
+      JS::NonIncrementalGC(entry->cx, JS::GCOptions::Shrink, JS::GCReason::API);
+    }
+    return entry;
+  }
+  context_pool.Drain();
+  return std::nullopt;
+}
+
+// Detaches the global from `bench` and, if `collect`, collects everything
+// the bench left behind, so the next user starts from an empty heap with warm
+// runtime-wide state (JIT stubs, caches, allocator).
+static void ReturnContextToPool(BenchState *bench, bool collect)
+{
+  JSContext *cx = bench->js->cx;
+  PooledContext entry;
+  entry.cx = cx;
+  entry.global = std::make_unique<JS::PersistentRootedObject>(cx, bench->js->global);
+  entry.heap_max_bytes = bench->options.heap_max_bytes;
+  entry.nursery_bytes = bench->options.nursery_bytes;
+  entry.abandoned = !collect;
+  {
+    JSAutoRealm ar(cx, bench->js->global);
+    JS_SetReservedSlot(bench->js->global, 0, JS::UndefinedValue());
+    if (!JS_DeleteProperty(cx, bench->js->global, "memory")) {
+      JS_ClearPendingException(cx);
+    }
+  }
+  bench->js.reset();
+  if (collect) {
+    JS::PrepareForFullGC(cx);
+    JS::NonIncrementalGC(cx, JS::GCOptions::Shrink, JS::GCReason::API);
+  }
+  JS_SetContextPrivate(cx, nullptr);
+  context_pool.context = std::move(entry);
+}
+
+// Undoes `wasm_bench_create` on its error paths once it has a context, so
+// that the context isn't left behind with its private and GC callbacks
+// pointing at the freed bench. Pooled contexts go back to the pool.
+struct CreateGuard {
+  BenchState *bench;
+  JSContext *cx;
+  bool pooled;
+
+  void Release() { cx = nullptr; }
+
+  ~CreateGuard()
+  {
+    if (!cx) return;
+    UninstallGcAccounting(cx);
+    JS_SetContextPrivate(cx, nullptr);
+    // The profiler's interrupt callback stays installed; see
+    // `wasm_bench_free`.
+    bool poolable = pooled && bench->js && !bench->profiler;
+    bench->profiler.reset();
+    if (poolable) {
+      ReturnContextToPool(bench, true);
+    } else {
+      bench->js.reset();
+      JS_DestroyContext(cx);
+    }
+  }
+};
+
+// Terminates wasm running on behalf of a bench whose wasi-threads threads
+// are being stopped. Contexts without a bench realm are never stopped.
+static bool StopThreadsInterruptCallback(JSContext *cx)
+{
+  JSObject *global = JS::CurrentGlobalOrNull(cx);
+  BenchState *bench = global ? JS::GetMaybePtrFromReservedSlot<BenchState>(global, 0) : nullptr;
+  return !bench || !bench->stopping;
+}
+
+// Creates and configures a context for `options`. Contexts of wasi-threads
+// pass the bench's main runtime as `parentRuntime`.
+static JSContext* NewBenchContext(const BenchOptions &options, JSRuntime *parentRuntime,
+                                  ContextTimings *timings = nullptr)
+{
+  uint32_t heapMaxBytes = options.heap_max_bytes ? options.heap_max_bytes
+                                                 : JS::DefaultHeapMaxBytes;
+  uint64_t start_ns = MonotonicNs();
+  JSContext* cx = JS_NewContext(heapMaxBytes, parentRuntime);
+  if (!cx) {
+    return nullptr;
+  }
+  uint64_t context_ns = MonotonicNs();
+
+  if (uint32_t nursery = options.nursery_bytes) {
+    // The minimum has to stay below the maximum for the maximum to apply.
+    if (nursery < JS_GetGCParameter(cx, JSGC_MIN_NURSERY_BYTES)) {
+      JS_SetGCParameter(cx, JSGC_MIN_NURSERY_BYTES, nursery);
+    }
+    JS_SetGCParameter(cx, JSGC_MAX_NURSERY_BYTES, nursery);
+  }
+
+  // Contexts of wasi-threads threads share the parent's self-hosted code.
+  bool useCache = options.fast_create && !parentRuntime;
+  bool cached = false;
+  JS::SelfHostedCache cache;
+  if (useCache) {
+    std::lock_guard<std::mutex> lock(self_hosted_cache_mutex);
+    cached = !self_hosted_cache.empty();
+    if (cached) {
+      cache = JS::SelfHostedCache(self_hosted_cache.data(), self_hosted_cache.size());
+    }
+  }
+  if (!JS::InitSelfHostedCode(cx, cache, useCache ? WriteSelfHostedCache : nullptr)) {
+    JS_DestroyContext(cx);
+    return nullptr;
+  }
+  if (timings) {
+    timings->new_context_ns = context_ns - start_ns;
+    timings->self_hosted_ns = MonotonicNs() - context_ns;
+    timings->self_hosted_cached = cached;
+  }
+
+  SetWasmTiers(cx, options);
+  if (!JS_AddInterruptCallback(cx, StopThreadsInterruptCallback)) {
+    JS_DestroyContext(cx);
+    return nullptr;
+  }
+
+  // Threaded wasm blocks in memory.atomic.wait on every thread, including
+  // the one running `_start`.
+  JS_SetFutexCanWait(cx);
+  return cx;
+}
+
+ExitCode wasm_bench_init_engine(const char *flags_ptr, size_t flags_len)
+{
+  BenchOptions options;
+  if (flags_ptr && !ParseBenchOptions(std::string(flags_ptr, flags_len), &options)) {
+    return BENCH_EXIT_ERR;
+  }
+  return EnsureEngineInitialized(options) ? BENCH_EXIT_OK : BENCH_EXIT_ERR;
+}
+
 /// Exposes a C-compatible way of creating the engine from the bytes of a single
 /// Wasm module.
 ///
@@ -77,6 +389,9 @@ ExitCode wasm_bench_create(WasmBenchConfig config, void **out_bench_pt)
 
   if (config.execution_flags_ptr) {
     bench->execution_flags = std::string(config.execution_flags_ptr, config.execution_flags_len);
+    if (!ParseBenchOptions(bench->execution_flags.value(), &bench->options)) {
+      return BENCH_EXIT_ERR;
+    }
   }
   bench->compilation_timer = config.compilation_timer;
   bench->compilation_start = config.compilation_start;
@@ -88,44 +403,89 @@ ExitCode wasm_bench_create(WasmBenchConfig config, void **out_bench_pt)
   bench->execution_start = config.execution_start;
   bench->execution_end = config.execution_end;
 
-  JSContext* cx = JS_NewContext(JS::DefaultHeapMaxBytes);
-  if (!cx) {
-    return BENCH_EXIT_ERR;
-  }
-
-  if (!JS::InitSelfHostedCode(cx)) {
+  if (!EnsureEngineInitialized(bench->options)) {
     return BENCH_EXIT_ERR;
   }
 
-  bool enableIon = true;
-  bool enableBaseline = false;
-  if (bench->execution_flags) {
-    const std::string& flags = bench->execution_flags.value();
-    if (flags == "baseline") {
-      enableIon = false;
-      enableBaseline = true;
-    } else if (flags == "ion") {
-      enableIon = true;
-      enableBaseline = false;
-    } else if (flags == "tier") {
-      enableBaseline = true;
+  if (bench->options.report) {
+    if (bench->options.report_path.empty()) {
+      bench->report = stderr;
+    } else {
+      bench->report = fopen(bench->options.report_path.c_str(), "a");
+      if (!bench->report) {
+        fprintf(stderr, "sm-bench: cannot open report '%s'\n", bench->options.report_path.c_str());
+        return BENCH_EXIT_ERR;
+      }
     }
   }
 
-  JS::ContextOptionsRef(cx)
-    .setWasm(true)
-    .setWasmBaseline(enableBaseline)
-    .setWasmIon(enableIon);
+  std::optional<PooledContext> pooled = TakePooledContext(bench->options);
+  uint64_t create_start_ns = MonotonicNs();
+  ContextTimings timings;
+  JSContext* cx;
+  if (pooled) {
+    cx = pooled->cx;
+    SetWasmTiers(cx, bench->options);
+  } else {
+    cx = NewBenchContext(bench->options, nullptr, &timings);
+  }
+  if (!cx) {
+    return BENCH_EXIT_ERR;
+  }
+  // Declared before anything rooted in `cx`, so it runs after their
+  // destructors.
+  CreateGuard guard{bench.get(), cx, pooled.has_value()};
+  bench->main_thread = std::this_thread::get_id();
+  bench->parent_runtime = JS_GetRuntime(cx);
+  bench->context_reused = pooled.has_value();
 
-  JS::RootedObject global(cx, CreateGlobal(cx));
+  uint64_t global_start_ns = MonotonicNs();
+  JS::RootedObject global(cx, pooled ? pooled->global->get()
+                                     : CreateGlobal(cx, bench->options.fast_create));
   if (!global) {
     return BENCH_EXIT_ERR;
   }
-  JS_SetReservedSlot(global, 0, JS::PrivateValue(bench.get()));
-
+  uint64_t global_ns = MonotonicNs() - global_start_ns;
+  pooled.reset();
   bench->js.emplace(cx);
   bench->js->global = global;
+  JS_SetReservedSlot(global, 0, JS::PrivateValue(bench.get()));
+  JS_SetContextPrivate(cx, bench.get());
+  if (bench->report) {
+    // Growth events are recorded inside the execution phase; avoid
+    // reallocating there.
+    bench->memory_growths.reserve(64);
+    InstallGcAccounting(cx);
+    BenchReport(bench.get(), "engine requested_bounds_checks=%s", RequestedBoundsChecks());
+  }
+
+  if (!bench->options.profile.empty()) {
+    bench->profiler = std::make_unique<SamplingProfiler>(cx, bench->options.profile_interval_us);
+    if (!bench->profiler->Init()) {
+      return BENCH_EXIT_ERR;
+    }
+  }
+
+  uint64_t imports_start_ns = MonotonicNs();
+  {
+    // Built here so that none of it is measured as instantiation.
+    JSAutoRealm ar(cx, global);
+    bench->js->imports = BuildImports(cx);
+    if (!bench->js->imports) {
+      ReportAndClearException(cx);
+      return BENCH_EXIT_ERR;
+    }
+  }
+  uint64_t create_end_ns = MonotonicNs();
+  BenchReport(bench.get(), "phase=create context=%s new_context_ns=%" PRIu64
+              " self_hosted_ns=%" PRIu64 " self_hosted_cache=%s global_ns=%" PRIu64
+              " imports_ns=%" PRIu64 " total_ns=%" PRIu64,
+              bench->context_reused ? "reused" : "fresh",
+              timings.new_context_ns, timings.self_hosted_ns,
+              !bench->options.fast_create ? "off" : timings.self_hosted_cached ? "hit" : "miss",
+              global_ns, create_end_ns - imports_start_ns, create_end_ns - create_start_ns);
 
+  guard.Release();
   *out_bench_pt = bench.release();
   return BENCH_EXIT_OK;
 }
@@ -136,8 +496,50 @@ ExitCode wasm_bench_free(void *state)
   std::unique_ptr<BenchState> bench(static_cast<BenchState*>(state));
 
   JSContext *cx = bench->js->cx;
-  bench->js.reset();
-  JS_DestroyContext(cx);
+  // Threads spawned by `_initialize` without a later execution.
+  StopWasiThreads(bench.get());
+  JoinWasiThreads(bench.get());
+  // The profiler leaves its interrupt callback installed on the context, so
+  // such contexts are never pooled.
+  bool poolable = !bench->profiler;
+  bench->profiler.reset();
+  bench->snapshot.reset();
+
+  // GCs that run from here on are still accounted to the bench through the
+  // context private.
+  uint64_t start_ns = MonotonicNs();
+  PhaseCounters counters_start = bench->counters;
+  uint64_t rss_start, va_start;
+  ProcessFootprint(&rss_start, &va_start);
+  uint64_t collect_ns = 0;
+  const char *mode;
+  if (poolable && bench->options.reuse_context) {
+    mode = "pooled";
+    ReturnContextToPool(bench.get(), true);
+    collect_ns = MonotonicNs() - start_ns;
+  } else if (poolable && bench->options.fast_teardown) {
+    // Kept for the next create on this thread, which can't make a new
+    // context while this one exists.
+    mode = "abandoned";
+    ReturnContextToPool(bench.get(), false);
+  } else {
+    // Timed as is: its final GC shows up in `gc_ns`.
+    mode = "destroyed";
+    bench->js.reset();
+    JS_DestroyContext(cx);
+  }
+  uint64_t end_ns = MonotonicNs();
+  uint64_t rss_end, va_end;
+  ProcessFootprint(&rss_end, &va_end);
+  const PhaseCounters &counters_end = bench->counters;
+  BenchReport(bench.get(), "phase=teardown mode=%s time_ns=%" PRIu64 " collect_ns=%" PRIu64
+              " major_gcs=%" PRIu64 " gc_ns=%" PRIu64 " va_released=%" PRId64
+              " rss_released=%" PRId64,
+              mode, end_ns - start_ns, collect_ns,
+              counters_end.major_gc_count - counters_start.major_gc_count,
+              counters_end.major_gc_ns - counters_start.major_gc_ns +
+              counters_end.minor_gc_ns - counters_start.minor_gc_ns,
+              (int64_t)(va_start - va_end), (int64_t)(rss_start - rss_end));
   bench.reset();
 
   return BENCH_EXIT_OK;
@@ -150,6 +552,81 @@ static JSObject* GetWasm(JSContext *cx, JS::HandleObject global)
   return &wasm.toObject();
 }
 
+static uint64_t Percentile(const std::vector<uint64_t> &sorted, unsigned percent)
+{
+  if (sorted.empty()) return 0;
+  return sorted[std::min(sorted.size() - 1, sorted.size() * percent / 100)];
+}
+
+// Rejects module shapes the engine as configured can't run, before they fail
+// somewhere less obvious inside compilation or instantiation.
+static bool CheckSupportedMemories(const WasmModuleInfo &info)
+{
+  size_t memories = info.memory_imports.size() + info.defined_memories.size();
+  if (memories > 1) {
+    fprintf(stderr, "sm-bench: multiple memories are not supported (module has %zu)\n",
+            memories);
+    return false;
+  }
+  bool is64 = (!info.memory_imports.empty() && info.memory_imports[0].type.is64) ||
+              (!info.defined_memories.empty() && info.defined_memories[0].is64);
+  if (is64) {
+    fprintf(stderr, "sm-bench: memory64 modules are not supported\n");
+    return false;
+  }
+  return true;
+}
+
+// Validates and compiles the module `compile_throughput` more times, outside
+// the timer, and reports the medians as bytes and functions per second. The
+// shape-normalized numbers are left out if `bench->module_info` couldn't be
+// parsed (`shape_known`).
+static bool MeasureCompileThroughput(JSContext *cx, BenchState *bench, JS::HandleObject wasm,
+                                     JS::HandleValue wasmModule, const JS::HandleValueArray &args,
+                                     size_t module_bytes, bool shape_known)
+{
+  uint32_t iterations = bench->options.compile_throughput;
+  std::vector<uint64_t> validate, compile;
+  for (uint32_t i = 0; i < iterations; i++) {
+    uint64_t start_ns = MonotonicNs();
+    JS::RootedValue valid(cx);
+    if (!JS_CallFunctionName(cx, wasm, "validate", args, &valid)) return false;
+    validate.push_back(MonotonicNs() - start_ns);
+  }
+  for (uint32_t i = 0; i < iterations; i++) {
+    uint64_t start_ns = MonotonicNs();
+    JS::RootedObject module_(cx);
+    if (!Construct(cx, wasmModule, args, &module_)) return false;
+    compile.push_back(MonotonicNs() - start_ns);
+  }
+  std::sort(validate.begin(), validate.end());
+  std::sort(compile.begin(), compile.end());
+
+  const WasmModuleInfo &info = bench->module_info;
+  uint64_t validate_ns = Percentile(validate, 50);
+  uint64_t compile_ns = Percentile(compile, 50);
+  double compile_s = std::max<uint64_t>(compile_ns, 1) / 1e9;
+  double validate_s = std::max<uint64_t>(validate_ns, 1) / 1e9;
+  if (!shape_known) {
+    BenchReport(bench, "phase=compilation throughput tier=%s iterations=%u module_bytes=%zu"
+                " shape=unknown validate_ns=%" PRIu64 " compile_ns=%" PRIu64
+                " validate_mb_per_s=%.2f module_mb_per_s=%.2f",
+                WasmTierName(bench->options), iterations, module_bytes, validate_ns,
+                compile_ns, module_bytes / 1e6 / validate_s, module_bytes / 1e6 / compile_s);
+    return true;
+  }
+  BenchReport(bench, "phase=compilation throughput tier=%s iterations=%u module_bytes=%zu"
+              " code_bytes=%zu functions=%zu imports=%zu function_imports=%zu exports=%zu"
+              " validate_ns=%" PRIu64 " compile_ns=%" PRIu64 " validate_mb_per_s=%.2f"
+              " module_mb_per_s=%.2f code_mb_per_s=%.2f functions_per_s=%.0f",
+              WasmTierName(bench->options), iterations, module_bytes, info.code_bytes,
+              info.function_count, info.import_count, info.function_imports, info.export_count,
+              validate_ns, compile_ns, module_bytes / 1e6 / validate_s,
+              module_bytes / 1e6 / compile_s, info.code_bytes / 1e6 / compile_s,
+              info.function_count / compile_s);
+  return true;
+}
+
 /// Compile the Wasm benchmark module.
 ExitCode wasm_bench_compile(void *state, const char *wasm_bytes, size_t wasm_bytes_length)
 {
@@ -157,9 +634,31 @@ ExitCode wasm_bench_compile(void *state, const char *wasm_bytes, size_t wasm_byt
   JSContext* cx = bench->js->cx;
   JSAutoRealm ar(cx, bench->js->global);
 
+  // A malformed module is reported by the compiler below.
+  bench->module_info = WasmModuleInfo();
+  bool shape_known =
+    ParseWasmModuleInfo((const uint8_t*)wasm_bytes, wasm_bytes_length, &bench->module_info);
+  if (!shape_known) {
+    bench->module_info = WasmModuleInfo();
+  } else if (!CheckSupportedMemories(bench->module_info)) {
+    return BENCH_EXIT_ERR;
+  }
+
+  // The snapshot reaches globals the module doesn't export through accessor
+  // functions added to the module.
+  const char *compiled_bytes = wasm_bytes;
+  size_t compiled_length = wasm_bytes_length;
+  bench->instrumented_wasm.clear();
+  if (bench->options.snapshot && !bench->module_info.internal_globals.empty() &&
+      AddGlobalAccessors((const uint8_t*)wasm_bytes, wasm_bytes_length, bench->module_info,
+                         &bench->instrumented_wasm)) {
+    compiled_bytes = (const char*)bench->instrumented_wasm.data();
+    compiled_length = bench->instrumented_wasm.size();
+  }
+
   // Construct Wasm module from bytes.
   JSObject* arrayBuffer = JS::NewArrayBufferWithUserOwnedContents(cx,
-    wasm_bytes_length, (void*)wasm_bytes);
+    compiled_length, (void*)compiled_bytes);
   if (!arrayBuffer) return BENCH_EXIT_ERR;
   JS::RootedValueArray<1> args(cx);
   args[0].setObject(*arrayBuffer);
@@ -168,7 +667,7 @@ ExitCode wasm_bench_compile(void *state, const char *wasm_bytes, size_t wasm_byt
   JS::RootedValue wasmModule(cx);
   if (!JS_GetProperty(cx, wasm, "Module", &wasmModule)) return BENCH_EXIT_ERR;
 
-  bench->compilation_start(bench->compilation_timer);
+  PhaseStart(bench, BenchPhase::Compilation);
 
   JS::RootedObject module_(cx);
   if (!Construct(cx, wasmModule, args, &module_)) {
@@ -176,9 +675,18 @@ ExitCode wasm_bench_compile(void *state, const char *wasm_bytes, size_t wasm_byt
     return BENCH_EXIT_ERR;
   }
 
-  bench->compilation_end(bench->compilation_timer);
+  PhaseEnd(bench, BenchPhase::Compilation);
 
   bench->js->module = module_;
+  bench->wasm_module = JS::GetWasmModule(module_);
+  ReportPhase(bench, BenchPhase::Compilation);
+
+  if (bench->options.compile_throughput &&
+      !MeasureCompileThroughput(cx, bench, wasm, wasmModule, args, wasm_bytes_length,
+                                shape_known)) {
+    ReportAndClearException(cx);
+    return BENCH_EXIT_ERR;
+  }
 
   return BENCH_EXIT_OK;
 }
@@ -187,7 +695,7 @@ static bool BenchStart(JSContext* cx, unsigned argc, JS::Value* vp)
 {
   JS::RootedObject global(cx, JS::CurrentGlobalOrNull(cx));
   BenchState* bench = JS::GetMaybePtrFromReservedSlot<BenchState>(global, 0);
-  bench->execution_start(bench->execution_timer);
+  PhaseStart(bench, BenchPhase::Execution);
   return true;
 }
 
@@ -195,30 +703,368 @@ static bool BenchEnd(JSContext* cx, unsigned argc, JS::Value* vp)
 {
   JS::RootedObject global(cx, JS::CurrentGlobalOrNull(cx));
   BenchState* bench = JS::GetMaybePtrFromReservedSlot<BenchState>(global, 0);
-  bench->execution_end(bench->execution_timer);
+  PhaseEnd(bench, BenchPhase::Execution);
+  return true;
+}
+
+// `bench.start`/`bench.end` of wasi-threads threads: phases are timed on the
+// main thread only.
+static bool BenchIgnore(JSContext* cx, unsigned argc, JS::Value* vp)
+{
+  JS::CallArgsFromVp(argc, vp).rval().setUndefined();
+  return true;
+}
+
+static JSObject* NewWasmMemory(JSContext *cx, BenchState *bench, const WasmMemoryType &type)
+{
+  const BenchOptions &options = bench->options;
+  uint64_t initial = std::max(type.initial_pages, options.memory_initial_pages);
+  std::optional<uint64_t> maximum = type.maximum_pages;
+  if (options.memory_maximum_pages) maximum = options.memory_maximum_pages;
+
+  JS::RootedObject descriptor(cx, JS_NewPlainObject(cx));
+  if (!descriptor) return nullptr;
+  JS::RootedValue value(cx, JS::NumberValue(double(initial)));
+  if (!JS_SetProperty(cx, descriptor, "initial", value)) return nullptr;
+  if (maximum) {
+    value.setNumber(double(*maximum));
+    if (!JS_SetProperty(cx, descriptor, "maximum", value)) return nullptr;
+  }
+  if (type.shared) {
+    value.setBoolean(true);
+    if (!JS_SetProperty(cx, descriptor, "shared", value)) return nullptr;
+  }
+
+  JS::RootedObject wasm(cx, GetWasm(cx, bench->js->global));
+  JS::RootedValue wasmMemory(cx);
+  if (!JS_GetProperty(cx, wasm, "Memory", &wasmMemory)) return nullptr;
+  JS::RootedValueArray<1> args(cx);
+  args[0].setObject(*descriptor);
+  JS::RootedObject memory(cx);
+  if (!Construct(cx, wasmMemory, args, &memory)) return nullptr;
+  return memory;
+}
+
+// Creates a memory for every memory the module imports (e.g. `env.memory`)
+// and adds it to `imports`. The first one is returned in `firstMemory`; it is
+// memory 0, which WASI uses unless the module exports a `memory`. Threads
+// spawned with wasi-threads pass the shared memory 0 as `sharedMemory`
+// instead of creating a new one.
+static bool AddMemoryImports(JSContext *cx, BenchState *bench, JS::HandleObject imports,
+                             JS::HandleObject sharedMemory, JS::MutableHandleObject firstMemory)
+{
+  for (const WasmMemoryImport &import : bench->module_info.memory_imports) {
+    JS::RootedObject memory(cx);
+    if (sharedMemory && !firstMemory) {
+      memory = sharedMemory;
+    } else {
+      memory = NewWasmMemory(cx, bench, import.type);
+      if (!memory) return false;
+    }
+
+    JS::RootedValue moduleValue(cx);
+    if (!JS_GetProperty(cx, imports, import.module.c_str(), &moduleValue)) return false;
+    if (!moduleValue.isObject()) {
+      JSObject *moduleObj = JS_NewPlainObject(cx);
+      if (!moduleObj) return false;
+      moduleValue.setObject(*moduleObj);
+      if (!JS_SetProperty(cx, imports, import.module.c_str(), moduleValue)) return false;
+    }
+    JS::RootedObject moduleObj(cx, &moduleValue.toObject());
+    JS::RootedValue memoryValue(cx, JS::ObjectValue(*memory));
+    if (!JS_SetProperty(cx, moduleObj, import.name.c_str(), memoryValue)) return false;
+
+    if (!firstMemory) firstMemory.set(memory);
+  }
   return true;
 }
 
-static JSObject* BuildImports(JSContext *cx)
+// Grows `memory` to the configured initial size, so that growth happens
+// before the execution phase rather than inside it.
+static bool PregrowMemory(JSContext *cx, BenchState *bench, JS::HandleObject memory)
+{
+  uint8_t *data; size_t length;
+  if (!GetWasmMemory(cx, bench->js->global, &data, &length)) return false;
+  uint64_t pages = length / 65536;
+  if (bench->options.memory_initial_pages <= pages) return true;
+
+  JS::RootedValueArray<1> args(cx);
+  args[0].setNumber(double(bench->options.memory_initial_pages - pages));
+  JS::RootedValue rval(cx);
+  return JS_CallFunctionName(cx, memory, "grow", args, &rval);
+}
+
+static bool WasiThreadSpawn(JSContext* cx, unsigned argc, JS::Value* vp);
+
+static JSObject* BuildImports(JSContext *cx, bool mainThread)
 {
   // Construct Wasm module instance with required imports.
   // Build "bench" imports object.
   JS::RootedObject benchImportObj(cx, JS_NewPlainObject(cx));
   if (!benchImportObj) return nullptr;
-  if (!JS_DefineFunction(cx, benchImportObj, "start", BenchStart, 0, 0)) return nullptr;
-  if (!JS_DefineFunction(cx, benchImportObj, "end", BenchEnd, 0, 0)) return nullptr;
+  JSNative start = mainThread ? BenchStart : BenchIgnore;
+  JSNative end = mainThread ? BenchEnd : BenchIgnore;
+  if (!JS_DefineFunction(cx, benchImportObj, "start", start, 0, 0)) return nullptr;
+  if (!JS_DefineFunction(cx, benchImportObj, "end", end, 0, 0)) return nullptr;
   JS::RootedValue benchImport(cx, JS::ObjectValue(*benchImportObj));
   // Build wasi imports object.
   JS::RootedObject wasiImportObj(cx, BuildWasiImports(cx));
+  if (!wasiImportObj) return nullptr;
   JS::RootedValue wasiImport(cx, JS::ObjectValue(*wasiImportObj));
+  // Build wasi-threads imports object.
+  JS::RootedObject threadsImportObj(cx, JS_NewPlainObject(cx));
+  if (!threadsImportObj) return nullptr;
+  if (!JS_DefineFunction(cx, threadsImportObj, "thread-spawn", WasiThreadSpawn, 1, 0)) return nullptr;
+  JS::RootedValue threadsImport(cx, JS::ObjectValue(*threadsImportObj));
   // Build imports bag.
   JS::RootedObject imports(cx, JS_NewPlainObject(cx));
   if (!imports) return nullptr;
   if (!JS_SetProperty(cx, imports, "bench", benchImport)) return nullptr;
   if (!JS_SetProperty(cx, imports, "wasi_snapshot_preview1", wasiImport)) return nullptr;
+  if (!JS_SetProperty(cx, imports, "wasi", threadsImport)) return nullptr;
   return imports;
 }
 
+static JS::CloneDataPolicy SharedMemoryClonePolicy()
+{
+  JS::CloneDataPolicy policy;
+  policy.allowIntraClusterClonableSharedObjects();
+  policy.allowSharedMemoryObjects();
+  return policy;
+}
+
+// Instantiates the module in a wasi-threads thread's own realm, against the
+// shared memory in `memoryClone`, and returns the instance's exports.
+static bool InstantiateWasiThread(JSContext *cx, JS::HandleObject global, BenchState *bench,
+                                  JSAutoStructuredCloneBuffer &memoryClone,
+                                  JS::MutableHandleObject exports)
+{
+  JS::RootedValue memory(cx);
+  if (!memoryClone.read(cx, &memory, SharedMemoryClonePolicy())) return false;
+  if (!JS_SetProperty(cx, global, "memory", memory)) return false;
+  JS::RootedObject memoryObj(cx, &memory.toObject());
+
+  // Objects can't be shared with the main thread's context.
+  JS::RootedObject imports(cx, BuildImports(cx, false));
+  if (!imports) return false;
+  JS::RootedObject importedMemory(cx);
+  if (!AddMemoryImports(cx, bench, imports, memoryObj, &importedMemory)) return false;
+
+  JS::RootedValueArray<2> args(cx);
+  JSObject *module = bench->wasm_module->createObject(cx);
+  if (!module) return false;
+  args[0].setObject(*module);
+  args[1].setObject(*imports);
+  JS::RootedObject wasm(cx, GetWasm(cx, global));
+  JS::RootedValue wasmInstance(cx);
+  if (!JS_GetProperty(cx, wasm, "Instance", &wasmInstance)) return false;
+  JS::RootedObject instance(cx);
+  if (!Construct(cx, wasmInstance, args, &instance)) return false;
+
+  JS::RootedValue exportsValue(cx);
+  if (!JS_GetProperty(cx, instance, "exports", &exportsValue)) return false;
+  exports.set(&exportsValue.toObject());
+  return true;
+}
+
+// Sets up the thread's context and instance, tells the spawning thread
+// through `started` whether that worked, then runs `wasi_thread_start`. A
+// trap or `proc_exit` in any thread stops all of them.
+static void WasiThreadMain(BenchState *bench, int32_t tid, int32_t startArg,
+                           std::unique_ptr<JSAutoStructuredCloneBuffer> memoryClone,
+                           std::promise<bool> started)
+{
+  JSContext *cx = NewBenchContext(bench->options, bench->parent_runtime);
+  if (!cx) {
+    fprintf(stderr, "sm-bench: cannot create context for thread %d\n", tid);
+    started.set_value(false);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(bench->threads_mutex);
+    // Registered under the lock so that `StopWasiThreads` either sees this
+    // context or has already set `stopping`.
+    if (!bench->stopping) bench->thread_contexts.push_back(cx);
+  }
+  {
+    JS::RootedObject global(cx, CreateGlobal(cx));
+    JS::RootedObject exports(cx);
+    bool ok = global && !bench->stopping;
+    if (ok) {
+      JSAutoRealm ar(cx, global);
+      JS_SetReservedSlot(global, 0, JS::PrivateValue(bench));
+      ok = InstantiateWasiThread(cx, global, bench, *memoryClone, &exports);
+      if (!ok && JS_IsExceptionPending(cx)) ReportAndClearException(cx);
+    }
+    started.set_value(ok);
+
+    if (ok) {
+      JSAutoRealm ar(cx, global);
+      JS::RootedValueArray<2> startArgs(cx);
+      startArgs[0].setInt32(tid);
+      startArgs[1].setInt32(startArg);
+      JS::RootedValue rval(cx);
+      if (!JS_CallFunctionName(cx, exports, "wasi_thread_start", startArgs, &rval)) {
+        // An uncatchable exception without a pending one is proc_exit, or
+        // this thread being stopped.
+        if (JS_IsExceptionPending(cx)) {
+          ReportAndClearException(cx);
+          bench->thread_trapped = true;
+        }
+        StopWasiThreads(bench);
+      }
+    }
+  }
+  memoryClone.reset();
+  {
+    std::lock_guard<std::mutex> lock(bench->threads_mutex);
+    auto &contexts = bench->thread_contexts;
+    contexts.erase(std::remove(contexts.begin(), contexts.end(), cx), contexts.end());
+  }
+  JS_DestroyContext(cx);
+}
+
+/// wasi-threads `thread-spawn`: starts a host thread with its own context
+/// that instantiates the same module against the shared memory. Returns the
+/// new thread id, or a negative errno if the thread could not be set up.
+static bool WasiThreadSpawn(JSContext* cx, unsigned argc, JS::Value* vp)
+{
+  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+  JS::RootedObject global(cx, JS::CurrentGlobalOrNull(cx));
+  BenchState* bench = JS::GetMaybePtrFromReservedSlot<BenchState>(global, 0);
+  int32_t startArg;
+  if (!JS::ToInt32(cx, args.get(0), &startArg)) return false;
+
+  JS::RootedValue memory(cx);
+  if (!JS_GetProperty(cx, global, "memory", &memory)) return false;
+  auto memoryClone = std::make_unique<JSAutoStructuredCloneBuffer>(
+    JS::StructuredCloneScope::SameProcess, nullptr, nullptr);
+  if (!memoryClone->write(cx, memory, JS::UndefinedHandleValue, SharedMemoryClonePolicy())) {
+    // Most likely the memory isn't shared.
+    ReportAndClearException(cx);
+    args.rval().setInt32(-int32_t(__WASI_ERRNO_INVAL));
+    return true;
+  }
+
+  int32_t tid = bench->next_thread_id++;
+  std::promise<bool> started;
+  std::future<bool> setup = started.get_future();
+  {
+    std::lock_guard<std::mutex> lock(bench->threads_mutex);
+    bench->threads.emplace_back(WasiThreadMain, bench, tid, startArg, std::move(memoryClone),
+                                std::move(started));
+  }
+  // The failed thread is joined with the others.
+  args.rval().setInt32(setup.get() ? tid : -int32_t(__WASI_ERRNO_AGAIN));
+  return true;
+}
+
+// Makes every running wasi-threads thread, and the main thread if called
+// from another one, stop at its next interrupt check. This also wakes
+// threads blocked in memory.atomic.wait.
+static void StopWasiThreads(BenchState *bench)
+{
+  std::lock_guard<std::mutex> lock(bench->threads_mutex);
+  bench->stopping = true;
+  for (JSContext *cx : bench->thread_contexts) {
+    JS_RequestInterruptCallback(cx);
+  }
+  if (std::this_thread::get_id() != bench->main_thread) {
+    JS_RequestInterruptCallback(bench->js->cx);
+  }
+}
+
+// Threads may spawn more threads, so keep joining until none are left.
+static void JoinWasiThreads(BenchState *bench)
+{
+  for (;;) {
+    std::vector<std::thread> threads;
+    {
+      std::lock_guard<std::mutex> lock(bench->threads_mutex);
+      threads.swap(bench->threads);
+    }
+    if (threads.empty()) return;
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+  }
+}
+
+// Looks up the instance's memory so `ObserveWasmMemory` also sees it outside
+// of WASI calls: right after instantiation and after `_start` returns.
+static void RefreshWasmMemory(JSContext *cx, BenchState *bench)
+{
+  JS::RootedValue memory(cx);
+  if (!JS_GetProperty(cx, bench->js->global, "memory", &memory) || !memory.isObject()) {
+    JS_ClearPendingException(cx);
+    return;
+  }
+  uint8_t *data; size_t length;
+  if (!GetWasmMemory(cx, bench->js->global, &data, &length)) {
+    JS_ClearPendingException(cx);
+  }
+}
+
+// Creates `instances` more instances of the module, each with its own
+// imported memories, and reports instantiation latency percentiles and the
+// average RSS and address space each instance added. Stops at the first
+// failure, which for huge-memory reservations is usually address-space
+// exhaustion.
+static bool MeasureInstances(JSContext *cx, BenchState *bench, JS::HandleValue wasmInstance)
+{
+  const BenchOptions &options = bench->options;
+  if (options.instances_keep) {
+    bench->js->kept_instances = JS::NewArrayObject(cx, 0);
+    if (!bench->js->kept_instances) return false;
+  }
+
+  std::vector<uint64_t> latencies;
+  latencies.reserve(options.instances);
+  uint64_t rss_before, va_before;
+  ProcessFootprint(&rss_before, &va_before);
+  bool failed = false;
+  JS::RootedObject imports(cx, bench->js->imports);
+  for (uint32_t i = 0; i < options.instances; i++) {
+    JS::RootedObject importedMemory(cx);
+    JS::RootedValueArray<2> args(cx);
+    args[0].setObject(*bench->js->module);
+    args[1].setObject(*imports);
+
+    uint64_t start_ns = MonotonicNs();
+    JS::RootedObject instance(cx);
+    bool ok = AddMemoryImports(cx, bench, imports, nullptr, &importedMemory) &&
+              Construct(cx, wasmInstance, args, &instance);
+    uint64_t end_ns = MonotonicNs();
+    if (!ok) {
+      fprintf(stderr, "sm-bench: instance %u failed:\n", i + 1);
+      if (JS_IsExceptionPending(cx)) ReportAndClearException(cx);
+      failed = true;
+      break;
+    }
+    latencies.push_back(end_ns - start_ns);
+
+    if (options.instances_keep &&
+        !JS_SetElement(cx, bench->js->kept_instances, i, instance)) {
+      return false;
+    }
+  }
+  uint64_t rss_after, va_after;
+  ProcessFootprint(&rss_after, &va_after);
+
+  size_t created = latencies.size();
+  size_t divisor = std::max<size_t>(created, 1);
+  std::sort(latencies.begin(), latencies.end());
+  BenchReport(bench, "phase=instantiation instances=%zu requested=%u kept=%d failed=%d"
+              " p50_ns=%" PRIu64 " p90_ns=%" PRIu64 " p99_ns=%" PRIu64 " max_ns=%" PRIu64
+              " rss_per_instance=%" PRId64 " va_per_instance=%" PRId64,
+              created, options.instances, options.instances_keep ? 1 : 0, failed ? 1 : 0,
+              Percentile(latencies, 50), Percentile(latencies, 90),
+              Percentile(latencies, 99), Percentile(latencies, 100),
+              (int64_t)(rss_after - rss_before) / (int64_t)divisor,
+              (int64_t)(va_after - va_before) / (int64_t)divisor);
+  return true;
+}
+
 /// Instantiate the Wasm benchmark module.
 ExitCode wasm_bench_instantiate(void *state)
 {
@@ -226,8 +1072,12 @@ ExitCode wasm_bench_instantiate(void *state)
   JSContext* cx = bench->js->cx;
   JSAutoRealm ar(cx, bench->js->global);
 
-  JS::RootedObject imports(cx, BuildImports(cx));
-  if (!imports) return BENCH_EXIT_ERR;
+  JS::RootedObject imports(cx, bench->js->imports);
+  JS::RootedObject importedMemory(cx);
+  if (!AddMemoryImports(cx, bench, imports, nullptr, &importedMemory)) {
+    ReportAndClearException(cx);
+    return BENCH_EXIT_ERR;
+  }
 
   JS::RootedValueArray<2> args(cx);
   args[0].setObject(*bench->js->module.get()); // module
@@ -237,7 +1087,7 @@ ExitCode wasm_bench_instantiate(void *state)
   JS::RootedValue wasmInstance(cx);
   if (!JS_GetProperty(cx, wasm, "Instance", &wasmInstance)) return BENCH_EXIT_ERR;
 
-  bench->instantiation_start(bench->instantiation_timer);
+  PhaseStart(bench, BenchPhase::Instantiation);
 
   JS::RootedObject instance_(cx);
   if (!Construct(cx, wasmInstance, args, &instance_)) {
@@ -245,20 +1095,104 @@ ExitCode wasm_bench_instantiate(void *state)
     return BENCH_EXIT_ERR;
   }
 
-  bench->instantiation_end(bench->instantiation_timer);
+  PhaseEnd(bench, BenchPhase::Instantiation);
 
   JS::RootedValue exports(cx);
-  if (!JS_GetProperty(cx, instance_, "exports", &exports)) return false;
+  if (!JS_GetProperty(cx, instance_, "exports", &exports)) return BENCH_EXIT_ERR;
   JS::RootedObject exportsObj(cx, &exports.toObject());
   JS::RootedValue memory(cx);
-  if (!JS_GetProperty(cx, exportsObj, "memory", &memory)) return false;
-  if (!JS_SetProperty(cx, bench->js->global, "memory", memory)) return false;
+  if (!JS_GetProperty(cx, exportsObj, "memory", &memory)) return BENCH_EXIT_ERR;
+  if (!memory.isObject() && importedMemory) {
+    memory.setObject(*importedMemory);
+  }
+  if (!JS_SetProperty(cx, bench->js->global, "memory", memory)) return BENCH_EXIT_ERR;
+  if (memory.isObject() && bench->options.memory_initial_pages) {
+    JS::RootedObject memoryObj(cx, &memory.toObject());
+    if (!PregrowMemory(cx, bench, memoryObj)) {
+      ReportAndClearException(cx);
+      return BENCH_EXIT_ERR;
+    }
+  }
 
   bench->js->instance = instance_;
 
+  JS::RootedValue entry(cx);
+  if (!JS_GetProperty(cx, exportsObj, bench->options.invoke.c_str(), &entry)) return BENCH_EXIT_ERR;
+  if (!entry.isObject() || !JS_ObjectIsFunction(&entry.toObject())) {
+    fprintf(stderr, "sm-bench: module has no exported function '%s'\n",
+            bench->options.invoke.c_str());
+    return BENCH_EXIT_ERR;
+  }
+  bench->js->entry = &entry.toObject();
+
+  // Reactor modules expect `_initialize` to run once before any other export.
+  bool hasInitialize = false;
+  if (!JS_HasProperty(cx, exportsObj, "_initialize", &hasInitialize)) return BENCH_EXIT_ERR;
+  if (hasInitialize) {
+    JS::RootedValue rval(cx);
+    if (!JS_CallFunctionName(cx, exportsObj, "_initialize", JS::HandleValueArray::empty(), &rval)) {
+      ReportAndClearException(cx);
+      return BENCH_EXIT_ERR;
+    }
+  }
+
+  RefreshWasmMemory(cx, bench);
+  if (bench->options.pretouch && bench->memory_base) {
+    PrefaultWasmMemory(bench->memory_base, bench->memory_length);
+  }
+
+  if (bench->options.snapshot) {
+    if (!bench->options.snapshot_init.empty()) {
+      JS::RootedValue rval(cx);
+      const char *init = bench->options.snapshot_init.c_str();
+      if (!JS_CallFunctionName(cx, exportsObj, init, JS::HandleValueArray::empty(), &rval)) {
+        ReportAndClearException(cx);
+        return BENCH_EXIT_ERR;
+      }
+    }
+    bench->snapshot = std::make_unique<InstanceSnapshot>(cx);
+    if (!bench->snapshot->Take(cx, bench, exportsObj)) {
+      ReportAndClearException(cx);
+      return BENCH_EXIT_ERR;
+    }
+  }
+  ReportPhase(bench, BenchPhase::Instantiation);
+
+  if (bench->options.instances && !MeasureInstances(cx, bench, wasmInstance)) {
+    ReportAndClearException(cx);
+    return BENCH_EXIT_ERR;
+  }
+
   return BENCH_EXIT_OK;
 }
 
+static bool BuildInvokeArgs(JSContext *cx, const BenchOptions &options,
+                            JS::MutableHandle<JS::StackGCVector<JS::Value>> args)
+{
+  for (const WasmArg &arg : options.args) {
+    JS::Value value;
+    switch (arg.type) {
+      case WasmArg::I32:
+        value = JS::Int32Value((int32_t)arg.i64);
+        break;
+      case WasmArg::I64: {
+        JS::BigInt *bigint = JS::NumberToBigInt(cx, arg.i64);
+        if (!bigint) return false;
+        value = JS::BigIntValue(bigint);
+        break;
+      }
+      case WasmArg::F32:
+        value = JS::DoubleValue((float)arg.f64);
+        break;
+      case WasmArg::F64:
+        value = JS::DoubleValue(arg.f64);
+        break;
+    }
+    if (!args.append(value)) return false;
+  }
+  return true;
+}
+
 /// Execute the Wasm benchmark module.
 ExitCode wasm_bench_execute(void *state)
 {
@@ -266,34 +1200,283 @@ ExitCode wasm_bench_execute(void *state)
   JSContext* cx = bench->js->cx;
   JSAutoRealm ar(cx, bench->js->global);
 
-  // Find `_start` method in exports.
-  JS::RootedValue exports(cx);
-  if (!JS_GetProperty(cx, bench->js->instance, "exports", &exports)) return BENCH_EXIT_ERR;
-  JS::RootedObject exportsObj(cx, &exports.toObject());
-  JS::RootedValue start(cx);
-  if (!JS_GetProperty(cx, exportsObj, "_start", &start)) return BENCH_EXIT_ERR;
+  JS::RootedValue entry(cx, JS::ObjectValue(*bench->js->entry));
+  JS::RootedValueVector args(cx);
+  if (!BuildInvokeArgs(cx, bench->options, &args)) return BENCH_EXIT_ERR;
+  // `_start` calls bench.start/bench.end itself; other exports are timed by
+  // the driver.
+  bool driverTimed = bench->options.invoke != "_start";
 
-  // BenchResult::Start/End are called from wasm
+  // Repeated executions start from the post-initialization state.
+  if (bench->snapshot && bench->executions > 0 && !bench->snapshot->Restore(cx, bench)) {
+    ReportAndClearException(cx);
+    return BENCH_EXIT_ERR;
+  }
+  bench->executions++;
+  bench->exited = false;
+  bench->exit_code = 0;
+  bench->stopping = false;
+  bench->thread_trapped = false;
+
+  if (bench->profiler) bench->profiler->Start();
 
   JS::RootedValue rval(cx);
-  if (!Call(cx, JS::UndefinedHandleValue, start, JS::HandleValueArray::empty(), &rval)) {
-    JS::RootedValue exc(cx);
-    if (!JS_GetPendingException(cx, &exc)) return BENCH_EXIT_ERR;
-    JS_ClearPendingException(cx);
-    // likely wasm procexit
-    // ReportAndClearException(cx);
+  if (driverTimed) PhaseStart(bench, BenchPhase::Execution);
+  bool ok = true;
+  for (uint32_t i = 0; ok && i < bench->options.iterations; i++) {
+    ok = Call(cx, JS::UndefinedHandleValue, entry, args, &rval);
+  }
+  if (driverTimed) PhaseEnd(bench, BenchPhase::Execution);
+  // As in wasi-threads, the process ends with the main thread: threads still
+  // running, e.g. blocked in memory.atomic.wait, are stopped.
+  StopWasiThreads(bench);
+  JoinWasiThreads(bench);
+
+  RefreshWasmMemory(cx, bench);
+  ReportPhase(bench, BenchPhase::Execution);
+
+  if (bench->profiler) {
+    bench->profiler->Stop();
+    if (!bench->profiler->WriteFoldedStacks(bench->options.profile)) return BENCH_EXIT_ERR;
+  }
+
+  if (bench->thread_trapped) {
+    fprintf(stderr, "sm-bench: a wasi-threads thread trapped\n");
+    if (JS_IsExceptionPending(cx)) JS_ClearPendingException(cx);
+    return BENCH_EXIT_ERR;
+  }
+  if (!ok) {
+    if (JS_IsExceptionPending(cx)) {
+      // A trap or an error thrown by a host function, not an exit.
+      ReportAndClearException(cx);
+      return BENCH_EXIT_ERR;
+    }
+    if (!bench->exited) {
+      fprintf(stderr, "sm-bench: execution was terminated\n");
+      return BENCH_EXIT_ERR;
+    }
+  }
+  if (bench->exited) {
+    BenchReport(bench, "exit code=%d", (int)bench->exit_code);
+    if (bench->exit_code != 0) {
+      fprintf(stderr, "sm-bench: benchmark exited with code %d\n", (int)bench->exit_code);
+      return BENCH_EXIT_ERR;
+    }
   }
   return BENCH_EXIT_OK;
 }
 
+// Compiles the modules of a suite on its own thread and context, at most one
+// module ahead of the one being run. Compiled modules are handed over as
+// JS::WasmModule, which any context in the process can instantiate.
+class SuiteCompiler {
+ public:
+  SuiteCompiler(const BenchOptions &options, const WasmBenchSuiteModule *modules, size_t count)
+    : options_(options), modules_(modules), compiled_(count), done_(count, false)
+  {
+    thread_ = std::thread([this] { Run(); });
+  }
 
-void bench_init() {
-  if (!JS_Init()) {
-    fprintf(stderr, "JS engine is not initialized\n");
-    exit(1);
+  ~SuiteCompiler()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      cancelled_ = true;
+      wanted_ = compiled_.size();
+    }
+    cond_.notify_all();
+    thread_.join();
+  }
+
+  /// Waits for module `index` and lets the compiler start on the next one.
+  /// Returns null if compilation failed.
+  RefPtr<JS::WasmModule> Take(size_t index)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    wanted_ = std::max(wanted_, index + 2);
+    cond_.notify_all();
+    cond_.wait(lock, [&] { return done_[index]; });
+    return std::move(compiled_[index]);
+  }
+
+ private:
+  void Run()
+  {
+    JSContext *cx = NewBenchContext(options_, nullptr);
+    if (cx) {
+      {
+        JS::RootedObject global(cx, CreateGlobal(cx, true));
+        CompileAll(cx, global);
+      }
+      JS_DestroyContext(cx);
+    }
+    {
+      // Unblock `Take` for modules never compiled.
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::fill(done_.begin(), done_.end(), true);
+    }
+    cond_.notify_all();
+  }
+
+  void CompileAll(JSContext *cx, JS::HandleObject global)
+  {
+    for (size_t i = 0; i < compiled_.size(); i++) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [&] { return i < wanted_; });
+        if (cancelled_) return;
+      }
+      RefPtr<JS::WasmModule> module = global ? Compile(cx, global, modules_[i]) : nullptr;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        compiled_[i] = std::move(module);
+        done_[i] = true;
+      }
+      cond_.notify_all();
+    }
+  }
+
+  static RefPtr<JS::WasmModule> Compile(JSContext *cx, JS::HandleObject global,
+                                        const WasmBenchSuiteModule &module)
+  {
+    JSAutoRealm ar(cx, global);
+    JS::RootedObject wasm(cx, GetWasm(cx, global));
+    JS::RootedValue wasmModule(cx);
+    JSObject *arrayBuffer = JS::NewArrayBufferWithUserOwnedContents(cx,
+      module.wasm_bytes_length, (void*)module.wasm_bytes);
+    if (!arrayBuffer || !JS_GetProperty(cx, wasm, "Module", &wasmModule)) {
+      ReportAndClearException(cx);
+      return nullptr;
+    }
+    JS::RootedValueArray<1> args(cx);
+    args[0].setObject(*arrayBuffer);
+    JS::RootedObject module_(cx);
+    if (!Construct(cx, wasmModule, args, &module_)) {
+      ReportAndClearException(cx);
+      return nullptr;
+    }
+    return JS::GetWasmModule(module_);
+  }
+
+  BenchOptions options_;
+  const WasmBenchSuiteModule *modules_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  // Modules [0, wanted_) may be compiled.
+  size_t wanted_ = 1;
+  bool cancelled_ = false;
+  std::vector<RefPtr<JS::WasmModule>> compiled_;
+  std::vector<bool> done_;
+  std::thread thread_;
+};
+
+// The compilation phase of a pipelined suite: waits for the background
+// compiler and adopts its module into the bench's realm.
+static ExitCode CompileFromSuite(BenchState *bench, SuiteCompiler &compiler, size_t index,
+                                 const WasmBenchSuiteModule &module)
+{
+  JSContext* cx = bench->js->cx;
+  JSAutoRealm ar(cx, bench->js->global);
+
+  bench->module_info = WasmModuleInfo();
+  if (!ParseWasmModuleInfo((const uint8_t*)module.wasm_bytes, module.wasm_bytes_length,
+                           &bench->module_info)) {
+    bench->module_info = WasmModuleInfo();
+  } else if (!CheckSupportedMemories(bench->module_info)) {
+    return BENCH_EXIT_ERR;
+  }
+
+  PhaseStart(bench, BenchPhase::Compilation);
+  RefPtr<JS::WasmModule> compiled = compiler.Take(index);
+  PhaseEnd(bench, BenchPhase::Compilation);
+  if (!compiled) return BENCH_EXIT_ERR;
+
+  JS::RootedObject module_(cx, compiled->createObject(cx));
+  if (!module_) {
+    ReportAndClearException(cx);
+    return BENCH_EXIT_ERR;
+  }
+  bench->js->module = module_;
+  bench->wasm_module = compiled;
+  ReportPhase(bench, BenchPhase::Compilation);
+  return BENCH_EXIT_OK;
+}
+
+ExitCode wasm_bench_run_suite(WasmBenchConfig config, const WasmBenchSuiteModule *modules,
+                              size_t count, ExitCode *results)
+{
+  BenchOptions options;
+  if (config.execution_flags_ptr &&
+      !ParseBenchOptions(std::string(config.execution_flags_ptr, config.execution_flags_len),
+                         &options)) {
+    return BENCH_EXIT_ERR;
+  }
+  if (!EnsureEngineInitialized(options)) {
+    return BENCH_EXIT_ERR;
+  }
+
+  uint64_t start_ns = MonotonicNs();
+  std::optional<SuiteCompiler> compiler;
+  if (!options.suite_serial) {
+    compiler.emplace(options, modules, count);
   }
+
+  size_t failed = 0;
+  for (size_t i = 0; i < count; i++) {
+    const WasmBenchSuiteModule &module = modules[i];
+    WasmBenchConfig moduleConfig = config;
+    if (module.working_dir_ptr) {
+      moduleConfig.working_dir_ptr = module.working_dir_ptr;
+      moduleConfig.working_dir_len = module.working_dir_len;
+    }
+
+    void *state = nullptr;
+    ExitCode result = wasm_bench_create(moduleConfig, &state);
+    if (result == BENCH_EXIT_OK) {
+      auto bench = static_cast<BenchState*>(state);
+      if (compiler) {
+        result = CompileFromSuite(bench, *compiler, i, module);
+      } else {
+        result = wasm_bench_compile(state, module.wasm_bytes, module.wasm_bytes_length);
+      }
+      if (result == BENCH_EXIT_OK) result = wasm_bench_instantiate(state);
+      if (result == BENCH_EXIT_OK) result = wasm_bench_execute(state);
+      if (wasm_bench_free(state) != BENCH_EXIT_OK) result = BENCH_EXIT_ERR;
+    } else if (compiler) {
+      // Keep the compiler moving past modules that couldn't be set up.
+      compiler->Take(i);
+    }
+    if (result != BENCH_EXIT_OK) {
+      fprintf(stderr, "sm-bench: suite module %zu failed\n", i);
+      failed++;
+    }
+    results[i] = result;
+  }
+  compiler.reset();
+
+  if (options.report) {
+    FILE *report = options.report_path.empty() ? stderr : fopen(options.report_path.c_str(), "a");
+    if (report) {
+      fprintf(report, "sm-bench: suite modules=%zu failed=%zu pipelined=%d wall_ns=%" PRIu64 "\n",
+              count, failed, options.suite_serial ? 0 : 1, MonotonicNs() - start_ns);
+      if (report != stderr) fclose(report);
+    }
+  }
+  return failed ? BENCH_EXIT_ERR : BENCH_EXIT_OK;
+}
+
+/// Report the current memory footprint of the process and of the instance.
+ExitCode wasm_bench_memory_stats(void *state, WasmBenchMemoryStats *out)
+{
+  auto bench = static_cast<BenchState*>(state);
+  JSAutoRealm ar(bench->js->cx, bench->js->global);
+  CollectMemoryStats(bench, out);
+  return BENCH_EXIT_OK;
 }
 
 void bench_fini() {
-  JS_ShutDown();
+  context_pool.Release();
+  if (engine_initialized && !leaked_contexts) {
+    JS_ShutDown();
+  }
 }
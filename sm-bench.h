@@ -1,7 +1,8 @@
 #ifndef SM_BENCH_H
 #define SM_BENCH_H
 
-#include <jsapi.h>
+#include <stddef.h>
+#include <stdint.h>
 
 typedef void (*TimerCallback)(void *timer);
 
@@ -46,11 +47,47 @@ struct WasmBenchConfig {
     TimerCallback execution_end;
 
     /// The (optional) flags to use when running Wasmtime. These correspond to
-    /// the flags used when running Wasmtime from the command line.
+    /// the flags used when running Wasmtime from the command line. See
+    /// `BenchOptions` for the flags understood by this driver.
     const char *execution_flags_ptr;
     size_t execution_flags_len;  
 };
 
+/// Memory footprint of the process and of the bench's instance, see
+/// `wasm_bench_memory_stats`.
+struct WasmBenchMemoryStats {
+    /// Current and peak resident set size of the process.
+    uint64_t rss_bytes;
+    uint64_t peak_rss_bytes;
+
+    /// Bytes allocated in the JS GC heap.
+    uint64_t js_heap_bytes;
+
+    /// Committed anonymous executable memory: JIT code of every tier, wasm
+    /// and JS, plus trampolines. mozjs-102 offers no per-tier breakdown.
+    uint64_t executable_bytes;
+
+    /// Accessible size of the instance's linear memory, and the address
+    /// space reserved for it starting at its base, including guard regions.
+    uint64_t linear_memory_bytes;
+    uint64_t linear_memory_reserved_bytes;
+
+    /// Largest linear memory length observed so far.
+    uint64_t linear_memory_high_water_bytes;
+
+    /// Part of the linear memory backed by transparent huge pages. Only
+    /// collected with the `thp` flag.
+    uint64_t linear_memory_huge_page_bytes;
+};
+
+/// Initializes the engine with the process-wide settings in `flags` (see
+/// `BenchOptions`) without creating a context. `wasm_bench_create` does this
+/// on first use; calling it up front lets a process that forks per run pay
+/// for engine initialization once. No threads are started, so the process
+/// can fork afterwards. Later creates must use the same process-wide flags.
+extern "C" ExitCode wasm_bench_init_engine(const char *flags_ptr, size_t flags_len)
+  __attribute__((visibility("default")));
+
 extern "C" ExitCode wasm_bench_create(WasmBenchConfig config, void **out_bench_pt)
   __attribute__((visibility("default")));
 
@@ -66,7 +103,31 @@ extern "C" ExitCode wasm_bench_instantiate(void *state)
 extern "C" ExitCode wasm_bench_execute(void *state)
   __attribute__((visibility("default")));
 
-void bench_init() __attribute__((constructor));
+/// One module of a suite, see `wasm_bench_run_suite`.
+struct WasmBenchSuiteModule {
+    /// The module's bytes; must stay valid until the suite returns.
+    const char *wasm_bytes;
+    size_t wasm_bytes_length;
+
+    /// The (optional) working directory for this module, overriding the
+    /// config's.
+    const char *working_dir_ptr;
+    size_t working_dir_len;
+};
+
+/// Runs create, compile, instantiate, execute and free for each of `count`
+/// modules with `config`, storing each module's exit code in `results`.
+/// Unless the `suite-serial` flag is set, module i+1 is compiled on a
+/// background thread while module i runs; the compilation timer then only
+/// measures the time spent waiting for that compilation. Returns an error if
+/// any module failed.
+extern "C" ExitCode wasm_bench_run_suite(WasmBenchConfig config, const WasmBenchSuiteModule *modules,
+                                         size_t count, ExitCode *results)
+  __attribute__((visibility("default")));
+
+extern "C" ExitCode wasm_bench_memory_stats(void *state, WasmBenchMemoryStats *out)
+  __attribute__((visibility("default")));
+
 void bench_fini() __attribute__((destructor));
 
 #endif // SM_BENCH_H
\ No newline at end of file
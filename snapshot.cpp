@@ -0,0 +1,195 @@
+#include <jsapi.h>
+#include <js/Array.h>
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "snapshot.h"
+#include "bench-state.h"
+#include "wasi-imports.h"
+#include "wasm-module-info.h"
+
+#ifdef __linux__
+static const uint64_t PAGEMAP_SOFT_DIRTY = 1ull << 55;
+
+static bool ClearSoftDirty()
+{
+  int fd = open("/proc/self/clear_refs", O_WRONLY);
+  if (fd < 0) return false;
+  bool ok = write(fd, "4", 1) == 1;
+  close(fd);
+  return ok;
+}
+
+static bool ReadPagemap(uint8_t *data, size_t pages, std::vector<uint64_t> *entries)
+{
+  int fd = open("/proc/self/pagemap", O_RDONLY);
+  if (fd < 0) return false;
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  entries->resize(pages);
+  size_t bytes = pages * sizeof(uint64_t);
+  off_t offset = ((uintptr_t)data / page_size) * sizeof(uint64_t);
+  bool ok = pread(fd, entries->data(), bytes, offset) == (ssize_t)bytes;
+  close(fd);
+  return ok;
+}
+
+// Soft-dirty tracking needs CONFIG_MEM_SOFT_DIRTY; check that a write after
+// clearing the bits is actually reported before relying on it.
+static bool SoftDirtyWorks(uint8_t *data)
+{
+  if (!ClearSoftDirty()) return false;
+  volatile uint8_t *p = data;
+  *p = *p;
+  std::vector<uint64_t> entries;
+  if (!ReadPagemap(data, 1, &entries) || !(entries[0] & PAGEMAP_SOFT_DIRTY)) return false;
+  return ClearSoftDirty();
+}
+#endif
+
+bool InstanceSnapshot::Take(JSContext *cx, BenchState *bench, JS::HandleObject exports)
+{
+  uint8_t *data; size_t length;
+  if (!GetWasmMemory(cx, bench->js->global, &data, &length)) return false;
+  memory_.assign(data, data + length);
+
+  JS::RootedValue wasm(cx);
+  if (!JS_GetProperty(cx, bench->js->global, "WebAssembly", &wasm)) return false;
+  JS::RootedObject wasmObj(cx, &wasm.toObject());
+  JS::RootedValue globalCtor(cx);
+  if (!JS_GetProperty(cx, wasmObj, "Global", &globalCtor)) return false;
+  JS::RootedObject globalCtorObj(cx, &globalCtor.toObject());
+
+  JS::Rooted<JS::IdVector> ids(cx, JS::IdVector(cx));
+  if (!JS_Enumerate(cx, exports, &ids)) return false;
+  JS::RootedObject pairs(cx, JS::NewArrayObject(cx, 0));
+  if (!pairs) return false;
+  uint32_t count = 0;
+  for (size_t i = 0; i < ids.length(); i++) {
+    JS::RootedValue exported(cx);
+    if (!JS_GetPropertyById(cx, exports, ids[i], &exported)) return false;
+    bool isGlobal = false;
+    if (exported.isObject() && !JS_HasInstance(cx, globalCtorObj, exported, &isGlobal)) return false;
+    if (!isGlobal) continue;
+
+    // Reading fails for v128 globals and writing the value back fails for
+    // immutable ones; neither needs restoring.
+    JS::RootedObject globalObj(cx, &exported.toObject());
+    JS::RootedValue value(cx);
+    if (!JS_GetProperty(cx, globalObj, "value", &value) ||
+        !JS_SetProperty(cx, globalObj, "value", value)) {
+      JS_ClearPendingException(cx);
+      continue;
+    }
+    if (!JS_SetElement(cx, pairs, count++, exported)) return false;
+    if (!JS_SetElement(cx, pairs, count++, value)) return false;
+  }
+
+  // Internal globals are read through the accessors compile added, and
+  // restored by calling the setter instead of setting `value`.
+  for (const WasmInternalGlobal &global : bench->module_info.internal_globals) {
+    // Missing if the module was compiled without them, e.g. in a suite.
+    JS::RootedValue setter(cx), value(cx);
+    std::string setterName = GlobalAccessorName(true, global.index);
+    if (!JS_GetProperty(cx, exports, setterName.c_str(), &setter)) return false;
+    if (!setter.isObject()) continue;
+    std::string getterName = GlobalAccessorName(false, global.index);
+    if (!JS_CallFunctionName(cx, exports, getterName.c_str(), JS::HandleValueArray::empty(),
+                             &value)) {
+      return false;
+    }
+    if (!JS_SetElement(cx, pairs, count++, setter)) return false;
+    if (!JS_SetElement(cx, pairs, count++, value)) return false;
+  }
+  globals_ = pairs;
+
+  // Soft-dirty tracking is armed by the first restore: clearing the bits
+  // write-protects every page, and only executions that are followed by a
+  // restore should pay for the faults.
+  soft_dirty_ = false;
+  soft_dirty_checked_ = length == 0;
+  return true;
+}
+
+bool InstanceSnapshot::RestoreMemory(uint8_t *data, size_t length, size_t *restored_pages)
+{
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t snapshot_length = std::min(memory_.size(), length);
+
+  // Memory can't shrink back to its snapshot size; pages grown since read
+  // as zero again instead.
+  if (length > memory_.size()) {
+#ifdef __linux__
+    madvise(data + memory_.size(), length - memory_.size(), MADV_DONTNEED);
+#else
+    memset(data + memory_.size(), 0, length - memory_.size());
+#endif
+  }
+
+#ifdef __linux__
+  if (soft_dirty_) {
+    std::vector<uint64_t> entries;
+    size_t pages = snapshot_length / page_size;
+    if (ReadPagemap(data, pages, &entries)) {
+      *restored_pages = 0;
+      for (size_t i = 0; i < pages; i++) {
+        if (entries[i] & PAGEMAP_SOFT_DIRTY) {
+          memcpy(data + i * page_size, memory_.data() + i * page_size, page_size);
+          (*restored_pages)++;
+        }
+      }
+      return ClearSoftDirty();
+    }
+    soft_dirty_ = false;
+  }
+#endif
+
+  memcpy(data, memory_.data(), snapshot_length);
+  *restored_pages = snapshot_length / page_size;
+#ifdef __linux__
+  if (!soft_dirty_checked_) {
+    soft_dirty_checked_ = true;
+    soft_dirty_ = SoftDirtyWorks(data);
+  }
+#endif
+  return true;
+}
+
+bool InstanceSnapshot::Restore(JSContext *cx, BenchState *bench)
+{
+  uint64_t start_ns = MonotonicNs();
+
+  uint8_t *data; size_t length;
+  if (!GetWasmMemory(cx, bench->js->global, &data, &length)) return false;
+  size_t restored_pages = 0;
+  if (!RestoreMemory(data, length, &restored_pages)) {
+    // The next restore would miss pages dirtied before this one.
+    soft_dirty_ = false;
+  }
+
+  uint32_t count;
+  if (!JS::GetArrayLength(cx, globals_, &count)) return false;
+  for (uint32_t i = 0; i + 1 < count; i += 2) {
+    JS::RootedValue global(cx), value(cx);
+    if (!JS_GetElement(cx, globals_, i, &global)) return false;
+    if (!JS_GetElement(cx, globals_, i + 1, &value)) return false;
+    JS::RootedObject globalObj(cx, &global.toObject());
+    if (JS_ObjectIsFunction(globalObj)) {
+      JS::RootedValue rval(cx);
+      if (!Call(cx, JS::UndefinedHandleValue, global, JS::HandleValueArray(value), &rval)) {
+        return false;
+      }
+    } else if (!JS_SetProperty(cx, globalObj, "value", value)) {
+      return false;
+    }
+  }
+
+  BenchReport(bench, "snapshot_restore pages=%zu soft_dirty=%d globals=%u time_ns=%" PRIu64,
+              restored_pages, soft_dirty_ ? 1 : 0, count / 2, MonotonicNs() - start_ns);
+  return true;
+}
@@ -0,0 +1,36 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <jsapi.h>
+
+#include <stdint.h>
+#include <vector>
+
+struct BenchState;
+
+/// Post-initialization state of an instance: the contents of its linear
+/// memory and the values of its mutable globals, exported or reachable
+/// through the accessors `AddGlobalAccessors` adds. The first restore copies
+/// all of memory back; later ones only the pages written since the previous
+/// restore, found through the kernel's soft-dirty page tracking where it is
+/// available.
+class InstanceSnapshot {
+ public:
+  InstanceSnapshot(JSContext *cx) : globals_(cx) {}
+
+  /// Must be called inside the bench's realm, after instantiation.
+  bool Take(JSContext *cx, BenchState *bench, JS::HandleObject exports);
+  bool Restore(JSContext *cx, BenchState *bench);
+
+ private:
+  bool RestoreMemory(uint8_t *data, size_t length, size_t *restored_pages);
+
+  std::vector<uint8_t> memory_;
+  bool soft_dirty_ = false;
+  bool soft_dirty_checked_ = false;
+  // Flattened [global, value, global, value, ...] pairs, where a global is
+  // a WebAssembly.Global or the setter of an internal global.
+  JS::PersistentRootedObject globals_;
+};
+
+#endif // SNAPSHOT_H
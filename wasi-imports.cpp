@@ -11,6 +11,7 @@
 #include <js/BigInt.h>
 
 #include <fstream>
+#include <mutex>
 #include <random>
 #include <sys/stat.h>
 #include <time.h>
@@ -18,11 +19,16 @@
 #include "wasi-imports.h"
 #include "bench-state.h"
 #include "wasi-api.h"
+#include "memory-stats.h"
 
-static bool GetWasmMemory(JSContext* cx, JS::HandleObject global, uint8_t **data_out, size_t *len_out)
+bool GetWasmMemory(JSContext* cx, JS::HandleObject global, uint8_t **data_out, size_t *len_out)
 {
   JS::RootedValue memory(cx);
   if (!JS_GetProperty(cx, global, "memory", &memory)) return false;
+  if (!memory.isObject()) {
+    JS_ReportErrorASCII(cx, "module neither exports nor imports a memory");
+    return false;
+  }
   JS::RootedObject memoryObj(cx, &memory.toObject());
   JS::RootedValue buffer(cx);
   if (!JS_GetProperty(cx, memoryObj, "buffer", &buffer)) return false;
@@ -30,6 +36,9 @@ static bool GetWasmMemory(JSContext* cx, JS::HandleObject global, uint8_t **data
   JS::GetArrayBufferMaybeSharedLengthAndData(&buffer.toObject(), &length, &shared, &data);
   *data_out = data;
   *len_out = length;
+
+  BenchState* state = JS::GetMaybePtrFromReservedSlot<BenchState>(global, 0);
+  ObserveWasmMemory(state, data, length);
   return true;
 }
 
@@ -37,6 +46,7 @@ bool WasiFdClose(JSContext* cx, unsigned argc, JS::Value* vp)
 {
   JS::RootedObject global(cx, JS::CurrentGlobalOrNull(cx));
   BenchState* state = JS::GetMaybePtrFromReservedSlot<BenchState>(global, 0);
+  std::lock_guard<std::mutex> lock(state->fd_mutex);
   uint8_t *data; size_t length;
   if (!GetWasmMemory(cx, global, &data, &length)) return false;
 
@@ -69,6 +79,7 @@ bool WasiFdFilestatGet(JSContext* cx, unsigned argc, JS::Value* vp)
 {
   JS::RootedObject global(cx, JS::CurrentGlobalOrNull(cx));
   BenchState* state = JS::GetMaybePtrFromReservedSlot<BenchState>(global, 0);
+  std::lock_guard<std::mutex> lock(state->fd_mutex);
   uint8_t *data; size_t length;
   if (!GetWasmMemory(cx, global, &data, &length)) return false;
 
@@ -97,6 +108,7 @@ bool WasiFdFdstatGet(JSContext* cx, unsigned argc, JS::Value* vp)
 {
   JS::RootedObject global(cx, JS::CurrentGlobalOrNull(cx));
   BenchState* state = JS::GetMaybePtrFromReservedSlot<BenchState>(global, 0);
+  std::lock_guard<std::mutex> lock(state->fd_mutex);
   uint8_t *data; size_t length;
   if (!GetWasmMemory(cx, global, &data, &length)) return false;
 
@@ -139,6 +151,7 @@ bool WasiFdSeek(JSContext* cx, unsigned argc, JS::Value* vp)
 {
   JS::RootedObject global(cx, JS::CurrentGlobalOrNull(cx));
   BenchState* state = JS::GetMaybePtrFromReservedSlot<BenchState>(global, 0);
+  std::lock_guard<std::mutex> lock(state->fd_mutex);
   uint8_t *data; size_t length;
   if (!GetWasmMemory(cx, global, &data, &length)) return false;
 
@@ -162,6 +175,7 @@ bool WasiFdRead(JSContext* cx, unsigned argc, JS::Value* vp)
 {
   JS::RootedObject global(cx, JS::CurrentGlobalOrNull(cx));
   BenchState* state = JS::GetMaybePtrFromReservedSlot<BenchState>(global, 0);
+  std::lock_guard<std::mutex> lock(state->fd_mutex);
   uint8_t *data; size_t length;
   if (!GetWasmMemory(cx, global, &data, &length)) return false;
 
@@ -203,6 +217,7 @@ bool WasiFdWrite(JSContext* cx, unsigned argc, JS::Value* vp)
 {
   JS::RootedObject global(cx, JS::CurrentGlobalOrNull(cx));
   BenchState* state = JS::GetMaybePtrFromReservedSlot<BenchState>(global, 0);
+  std::lock_guard<std::mutex> lock(state->fd_mutex);
   uint8_t *data; size_t length;
   if (!GetWasmMemory(cx, global, &data, &length)) return false;
 
@@ -235,6 +250,7 @@ bool WasiPathOpen(JSContext* cx, unsigned argc, JS::Value* vp)
 {
   JS::RootedObject global(cx, JS::CurrentGlobalOrNull(cx));
   BenchState* state = JS::GetMaybePtrFromReservedSlot<BenchState>(global, 0);
+  std::lock_guard<std::mutex> lock(state->fd_mutex);
   uint8_t *data; size_t length;
   if (!GetWasmMemory(cx, global, &data, &length)) return false;
 
@@ -264,6 +280,7 @@ bool WasiPathFilestatGet(JSContext* cx, unsigned argc, JS::Value* vp)
 {
   JS::RootedObject global(cx, JS::CurrentGlobalOrNull(cx));
   BenchState* state = JS::GetMaybePtrFromReservedSlot<BenchState>(global, 0);
+  std::lock_guard<std::mutex> lock(state->fd_mutex);
   uint8_t *data; size_t length;
   if (!GetWasmMemory(cx, global, &data, &length)) return false;
 
@@ -341,9 +358,18 @@ bool WasiFdPrestatDirName(JSContext* cx, unsigned argc, JS::Value* vp)
 }
 bool WasiProcExit(JSContext* cx, unsigned argc, JS::Value* vp)
 {
-    JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
-    JS_ReportErrorUTF8(cx, "procexit(%d)", args.get(0).toInt32());
-    return false;
+  JS::RootedObject global(cx, JS::CurrentGlobalOrNull(cx));
+  BenchState* state = JS::GetMaybePtrFromReservedSlot<BenchState>(global, 0);
+
+  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+  // Several threads may exit at once; the first code is kept.
+  bool already_exited = false;
+  if (state->exited.compare_exchange_strong(already_exited, true)) {
+    state->exit_code = args.get(0).toInt32();
+  }
+  // Returning false without a pending exception unwinds as an uncatchable
+  // exception, without allocating an error object inside the timed window.
+  return false;
 }
 bool WasiEnvironSizesGet(JSContext* cx, unsigned argc, JS::Value* vp)
 {
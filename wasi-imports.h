@@ -5,4 +5,8 @@
 
 JSObject* BuildWasiImports(JSContext *cx);
 
+/// Returns the base and length of the linear memory stored in the global's
+/// `memory` property.
+bool GetWasmMemory(JSContext* cx, JS::HandleObject global, uint8_t **data_out, size_t *len_out);
+
 #endif // IMPORTS_H
\ No newline at end of file
@@ -0,0 +1,89 @@
+// Command-line front end of the synthetic module generator.
+//
+// Usage: wasm-gen [<param>=<value> ...] -o out.wasm
+//   functions=<n>         generated functions (default 100)
+//   body-size=<n>         statements per function (default 50)
+//   locals=<n>            i32 locals per function (default 4)
+//   nesting=<n>           block/loop/if nesting depth (default 0)
+//   simd-density=<0..1>   fraction of v128 statements (default 0)
+//   fanout=<n>            calls per function (default 0)
+//   seed=<n>              random seed (default 1)
+//
+//        wasm-gen --hostcall <import> [size=<n>] [calls=<n>] -o out.wasm
+//   Emits a module calling one WASI import in a loop; see HostCallImports().
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "wasm-gen.h"
+
+int main(int argc, char **argv)
+{
+  WasmGenParams params;
+  HostCallParams hostcall;
+  std::string output;
+  // Parameters are applied once the mode is known, so `--hostcall` may come
+  // anywhere on the command line.
+  std::vector<std::string> assignments;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-o" && i + 1 < argc) {
+      output = argv[++i];
+    } else if (arg == "--hostcall" && i + 1 < argc) {
+      hostcall.import = argv[++i];
+    } else if (arg.find('=') != std::string::npos) {
+      assignments.push_back(arg);
+    } else {
+      fprintf(stderr, "wasm-gen: unexpected argument '%s'\n", arg.c_str());
+      return 2;
+    }
+  }
+
+  bool hostcall_mode = !hostcall.import.empty();
+  for (const std::string &arg : assignments) {
+    size_t eq = arg.find('=');
+    std::string name = arg.substr(0, eq), value = arg.substr(eq + 1);
+    bool hostcall_param = name == "size" || name == "calls";
+    if (hostcall_param != hostcall_mode) {
+      fprintf(stderr, hostcall_mode ? "wasm-gen: '%s' does not apply to --hostcall\n"
+                                    : "wasm-gen: '%s' only applies to --hostcall\n",
+              name.c_str());
+      return 2;
+    }
+    if (!hostcall_mode) {
+      if (!SetWasmGenParam(name, value, &params)) return 2;
+      continue;
+    }
+    char *end = nullptr;
+    unsigned long long n = strtoull(value.c_str(), &end, 10);
+    if (end == value.c_str() || *end != '\0' || n > UINT32_MAX) {
+      fprintf(stderr, "wasm-gen: invalid value for '%s': '%s'\n", name.c_str(), value.c_str());
+      return 2;
+    }
+    if (name == "size") hostcall.size = n;
+    else hostcall.calls = n;
+  }
+  if (output.empty()) {
+    fprintf(stderr, "usage: wasm-gen [<param>=<value> ...] -o out.wasm\n"
+                    "       wasm-gen --hostcall <import> [size=<n>] [calls=<n>] -o out.wasm\n");
+    return 2;
+  }
+
+  std::vector<uint8_t> wasm;
+  if (!hostcall_mode) {
+    GenerateWasmModule(params, &wasm);
+  } else if (!GenerateHostCallModule(hostcall, &wasm)) {
+    return 2;
+  }
+  std::ofstream out(output, std::ios::binary);
+  out.write((const char*)wasm.data(), wasm.size());
+  if (!out) {
+    fprintf(stderr, "wasm-gen: cannot write '%s'\n", output.c_str());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,539 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include "wasm-gen.h"
+
+namespace {
+
+enum Opcode : uint8_t {
+  OP_BLOCK = 0x02,
+  OP_LOOP = 0x03,
+  OP_IF = 0x04,
+  OP_ELSE = 0x05,
+  OP_END = 0x0b,
+  OP_BR_IF = 0x0d,
+  OP_CALL = 0x10,
+  OP_DROP = 0x1a,
+  OP_LOCAL_GET = 0x20,
+  OP_LOCAL_SET = 0x21,
+  OP_LOCAL_TEE = 0x22,
+  OP_I32_STORE = 0x36,
+  OP_I32_CONST = 0x41,
+  OP_I64_CONST = 0x42,
+  OP_I32_LT_U = 0x49,
+  OP_I32_GT_S = 0x4a,
+  OP_I32_ADD = 0x6a,
+  OP_I32_SUB = 0x6b,
+  OP_I32_MUL = 0x6c,
+  OP_I32_XOR = 0x73,
+  OP_SIMD_PREFIX = 0xfd,
+};
+
+// Sub-opcodes after OP_SIMD_PREFIX.
+enum SimdOpcode : uint32_t {
+  SIMD_V128_CONST = 12,
+  SIMD_I32X4_ADD = 174,
+  SIMD_I32X4_MUL = 181,
+  SIMD_F32X4_ADD = 228,
+};
+
+const uint8_t TYPE_I32 = 0x7f;
+const uint8_t TYPE_I64 = 0x7e;
+const uint8_t TYPE_V128 = 0x7b;
+const uint8_t TYPE_FUNC = 0x60;
+const uint8_t BLOCK_VOID = 0x40;
+
+class Writer {
+ public:
+  std::vector<uint8_t> bytes;
+
+  void Byte(uint8_t b) { bytes.push_back(b); }
+
+  void VarU32(uint32_t value)
+  {
+    do {
+      uint8_t b = value & 0x7f;
+      value >>= 7;
+      if (value) b |= 0x80;
+      bytes.push_back(b);
+    } while (value);
+  }
+
+  void VarS64(int64_t value)
+  {
+    for (;;) {
+      uint8_t b = value & 0x7f;
+      value >>= 7;
+      if ((value == 0 && !(b & 0x40)) || (value == -1 && (b & 0x40))) {
+        bytes.push_back(b);
+        return;
+      }
+      bytes.push_back(b | 0x80);
+    }
+  }
+
+  void I32Const(int32_t value)
+  {
+    Byte(OP_I32_CONST);
+    VarS64(value);
+  }
+
+  void Name(const std::string &name)
+  {
+    VarU32(name.size());
+    bytes.insert(bytes.end(), name.begin(), name.end());
+  }
+
+  void Append(const std::vector<uint8_t> &other)
+  {
+    bytes.insert(bytes.end(), other.begin(), other.end());
+  }
+
+  void Section(uint8_t id, const Writer &content)
+  {
+    Byte(id);
+    VarU32(content.bytes.size());
+    Append(content.bytes);
+  }
+};
+
+// xorshift32; the generator only needs to be deterministic per seed.
+class Random {
+ public:
+  explicit Random(uint32_t seed) : state_(seed ? seed : 1) {}
+
+  uint32_t Next()
+  {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 17;
+    state_ ^= state_ << 5;
+    return state_;
+  }
+
+  uint32_t Below(uint32_t n) { return n ? Next() % n : 0; }
+  double Unit() { return Next() / 4294967296.0; }
+
+ private:
+  uint32_t state_;
+};
+
+class BodyGenerator {
+ public:
+  BodyGenerator(const WasmGenParams &params, Random &random, uint32_t index)
+    : params_(params), random_(random), index_(index), simd_(params.simd_density > 0) {}
+
+  void Generate(Writer &out)
+  {
+    Writer body;
+    uint32_t groups = (params_.locals ? 1 : 0) + (simd_ ? 1 : 0);
+    body.VarU32(groups);
+    if (params_.locals) {
+      body.VarU32(params_.locals);
+      body.Byte(TYPE_I32);
+    }
+    if (simd_) {
+      body.VarU32(1);
+      body.Byte(TYPE_V128);
+      body.Byte(OP_SIMD_PREFIX);
+      body.VarU32(SIMD_V128_CONST);
+      for (int i = 0; i < 16; i++) body.Byte(random_.Next());
+      body.Byte(OP_LOCAL_SET);
+      body.VarU32(V128Local());
+    }
+
+    Calls(body);
+    Nest(body, params_.nesting, params_.body_size);
+
+    body.Byte(OP_LOCAL_GET);
+    body.VarU32(0);
+    body.Byte(OP_END);
+
+    out.VarU32(body.bytes.size());
+    out.Append(body.bytes);
+  }
+
+ private:
+  // Local 0 is the parameter, followed by the i32 locals and the v128 one.
+  uint32_t I32Local() { return random_.Below(params_.locals + 1); }
+  uint32_t V128Local() { return params_.locals + 1; }
+
+  // The parameter is a call depth budget: each call passes it on minus one
+  // and only happens while it is positive, so the number of calls made at
+  // run time is bounded by fanout^n for an argument n. Calls come first,
+  // before any statement can overwrite the parameter, and their results
+  // never go to it.
+  void Calls(Writer &body)
+  {
+    for (uint32_t i = 0; i < params_.fanout; i++) {
+      uint32_t callee = index_ + 1 + i;
+      if (callee >= params_.functions) break;
+      body.Byte(OP_LOCAL_GET);
+      body.VarU32(0);
+      body.I32Const(0);
+      body.Byte(OP_I32_GT_S);
+      body.Byte(OP_IF);
+      body.Byte(BLOCK_VOID);
+      body.Byte(OP_LOCAL_GET);
+      body.VarU32(0);
+      body.I32Const(1);
+      body.Byte(OP_I32_SUB);
+      body.Byte(OP_CALL);
+      body.VarU32(callee);
+      if (params_.locals) {
+        body.Byte(OP_LOCAL_SET);
+        body.VarU32(1 + random_.Below(params_.locals));
+      } else {
+        body.Byte(OP_DROP);
+      }
+      body.Byte(OP_END);
+    }
+  }
+
+  void Statements(Writer &body, uint32_t count)
+  {
+    for (uint32_t i = 0; i < count; i++) {
+      if (simd_ && random_.Unit() < params_.simd_density) {
+        static const uint32_t ops[] = {SIMD_I32X4_ADD, SIMD_I32X4_MUL, SIMD_F32X4_ADD};
+        body.Byte(OP_LOCAL_GET);
+        body.VarU32(V128Local());
+        body.Byte(OP_LOCAL_GET);
+        body.VarU32(V128Local());
+        body.Byte(OP_SIMD_PREFIX);
+        body.VarU32(ops[random_.Below(3)]);
+        body.Byte(OP_LOCAL_SET);
+        body.VarU32(V128Local());
+      } else {
+        static const uint8_t ops[] = {OP_I32_ADD, OP_I32_MUL, OP_I32_XOR};
+        body.Byte(OP_LOCAL_GET);
+        body.VarU32(I32Local());
+        body.Byte(OP_LOCAL_GET);
+        body.VarU32(I32Local());
+        body.Byte(ops[random_.Below(3)]);
+        body.Byte(OP_LOCAL_SET);
+        body.VarU32(I32Local());
+      }
+    }
+  }
+
+  // Spreads `count` statements over `depth` nested structures, cycling
+  // through block (with a conditional exit), loop (without a back edge, so
+  // the code terminates) and if/else.
+  void Nest(Writer &body, uint32_t depth, uint32_t count)
+  {
+    if (depth == 0) {
+      Statements(body, count);
+      return;
+    }
+    uint32_t here = count / (depth + 1);
+    uint32_t inner = count - here;
+    Statements(body, here);
+    switch (depth % 3) {
+      case 0:
+        body.Byte(OP_BLOCK);
+        body.Byte(BLOCK_VOID);
+        body.Byte(OP_LOCAL_GET);
+        body.VarU32(0);
+        body.Byte(OP_BR_IF);
+        body.VarU32(0);
+        Nest(body, depth - 1, inner);
+        body.Byte(OP_END);
+        break;
+      case 1:
+        body.Byte(OP_LOOP);
+        body.Byte(BLOCK_VOID);
+        Nest(body, depth - 1, inner);
+        body.Byte(OP_END);
+        break;
+      case 2:
+        body.Byte(OP_LOCAL_GET);
+        body.VarU32(0);
+        body.Byte(OP_IF);
+        body.Byte(BLOCK_VOID);
+        Nest(body, depth - 1, inner / 2);
+        body.Byte(OP_ELSE);
+        Statements(body, inner - inner / 2);
+        body.Byte(OP_END);
+        break;
+    }
+  }
+
+  const WasmGenParams &params_;
+  Random &random_;
+  uint32_t index_;
+  bool simd_;
+};
+
+bool ParseUint(const std::string &name, const std::string &value, uint32_t *out)
+{
+  char *end = nullptr;
+  unsigned long n = strtoul(value.c_str(), &end, 10);
+  if (end == value.c_str() || *end != '\0' || n > UINT32_MAX) {
+    fprintf(stderr, "wasm-gen: invalid value for '%s': '%s'\n", name.c_str(), value.c_str());
+    return false;
+  }
+  *out = (uint32_t)n;
+  return true;
+}
+
+} // namespace
+
+bool SetWasmGenParam(const std::string &name, const std::string &value, WasmGenParams *out)
+{
+  if (name == "functions") return ParseUint(name, value, &out->functions);
+  if (name == "body-size") return ParseUint(name, value, &out->body_size);
+  if (name == "locals") return ParseUint(name, value, &out->locals);
+  if (name == "nesting") return ParseUint(name, value, &out->nesting);
+  if (name == "fanout") return ParseUint(name, value, &out->fanout);
+  if (name == "seed") return ParseUint(name, value, &out->seed);
+  if (name == "simd-density") {
+    char *end = nullptr;
+    double density = strtod(value.c_str(), &end);
+    if (end == value.c_str() || *end != '\0' || density < 0 || density > 1) {
+      fprintf(stderr, "wasm-gen: simd-density must be between 0 and 1: '%s'\n", value.c_str());
+      return false;
+    }
+    out->simd_density = density;
+    return true;
+  }
+  fprintf(stderr, "wasm-gen: unknown parameter '%s'\n", name.c_str());
+  return false;
+}
+
+void GenerateWasmModule(const WasmGenParams &params, std::vector<uint8_t> *out)
+{
+  static const uint8_t header[8] = {0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00};
+  Writer module;
+  module.bytes.assign(header, header + sizeof(header));
+  Random random(params.seed);
+  uint32_t start_index = params.functions;
+
+  // Type 0: (i32) -> i32 for generated functions; type 1: () -> () for
+  // `_start`.
+  Writer types;
+  types.VarU32(2);
+  types.Byte(TYPE_FUNC);
+  types.VarU32(1);
+  types.Byte(TYPE_I32);
+  types.VarU32(1);
+  types.Byte(TYPE_I32);
+  types.Byte(TYPE_FUNC);
+  types.VarU32(0);
+  types.VarU32(0);
+  module.Section(1, types);
+
+  Writer functions;
+  functions.VarU32(params.functions + 1);
+  for (uint32_t i = 0; i < params.functions; i++) functions.VarU32(0);
+  functions.VarU32(1);
+  module.Section(3, functions);
+
+  Writer exports;
+  exports.VarU32(params.functions ? 2 : 1);
+  exports.Name("_start");
+  exports.Byte(0);
+  exports.VarU32(start_index);
+  if (params.functions) {
+    exports.Name("run");
+    exports.Byte(0);
+    exports.VarU32(0);
+  }
+  module.Section(7, exports);
+
+  Writer code;
+  code.VarU32(params.functions + 1);
+  for (uint32_t i = 0; i < params.functions; i++) {
+    BodyGenerator(params, random, i).Generate(code);
+  }
+  // `_start`: no locals, empty body.
+  code.VarU32(2);
+  code.VarU32(0);
+  code.Byte(OP_END);
+  module.Section(10, code);
+
+  *out = std::move(module.bytes);
+}
+
+// Memory layout of host-call modules: an iovec at 0, results at 16 and up,
+// and the data buffer at 64.
+static const int32_t HOSTCALL_IOVEC = 0;
+static const int32_t HOSTCALL_RESULT = 16;
+static const int32_t HOSTCALL_BUFFER = 64;
+
+const std::vector<std::string>& HostCallImports()
+{
+  static const std::vector<std::string> imports = {
+    "fd_write", "random_get", "clock_time_get", "clock_res_get", "args_sizes_get",
+    "args_get", "environ_sizes_get", "environ_get", "fd_fdstat_get", "fd_prestat_get",
+  };
+  return imports;
+}
+
+bool HostCallIsSized(const std::string &import)
+{
+  return import == "fd_write" || import == "random_get";
+}
+
+// Pushes the signature's parameters for one call of `import`.
+static void HostCallArgs(const HostCallParams &params, Writer &body)
+{
+  const std::string &import = params.import;
+  if (import == "fd_write") {
+    // fd_write(stdout, iovs, 1, nwritten)
+    body.I32Const(1);
+    body.I32Const(HOSTCALL_IOVEC);
+    body.I32Const(1);
+    body.I32Const(HOSTCALL_RESULT);
+  } else if (import == "random_get") {
+    body.I32Const(HOSTCALL_BUFFER);
+    body.I32Const(params.size);
+  } else if (import == "clock_time_get") {
+    // clock_time_get(monotonic, precision, time)
+    body.I32Const(1);
+    body.Byte(OP_I64_CONST);
+    body.VarS64(0);
+    body.I32Const(HOSTCALL_RESULT);
+  } else if (import == "clock_res_get") {
+    body.I32Const(1);
+    body.I32Const(HOSTCALL_RESULT);
+  } else if (import == "fd_fdstat_get") {
+    body.I32Const(1);
+    body.I32Const(HOSTCALL_BUFFER);
+  } else if (import == "args_get" || import == "environ_get") {
+    // Pointers at the result area, strings in the buffer.
+    body.I32Const(HOSTCALL_RESULT);
+    body.I32Const(HOSTCALL_BUFFER);
+  } else if (import == "fd_prestat_get") {
+    // The preopened working directory.
+    body.I32Const(3);
+    body.I32Const(HOSTCALL_RESULT);
+  } else {
+    // args_sizes_get, environ_sizes_get
+    body.I32Const(HOSTCALL_RESULT);
+    body.I32Const(HOSTCALL_RESULT + 4);
+  }
+}
+
+bool GenerateHostCallModule(const HostCallParams &params, std::vector<uint8_t> *out)
+{
+  const std::vector<std::string> &imports = HostCallImports();
+  if (std::find(imports.begin(), imports.end(), params.import) == imports.end()) {
+    fprintf(stderr, "wasm-gen: unsupported host call '%s'\n", params.import.c_str());
+    return false;
+  }
+  // The loop runs at least once, and both values become i32 constants.
+  if (params.calls == 0 || params.calls > INT32_MAX) {
+    fprintf(stderr, "wasm-gen: calls must be between 1 and %d\n", INT32_MAX);
+    return false;
+  }
+  if (params.size > INT32_MAX - HOSTCALL_BUFFER) {
+    fprintf(stderr, "wasm-gen: size must be at most %d\n", INT32_MAX - HOSTCALL_BUFFER);
+    return false;
+  }
+
+  static const uint8_t header[8] = {0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00};
+  Writer module;
+  module.bytes.assign(header, header + sizeof(header));
+
+  // Type 0: () -> (); type 1: the import's signature, returning an errno.
+  std::vector<uint8_t> param_types(params.import == "fd_write" ? 4 : 2, TYPE_I32);
+  if (params.import == "clock_time_get") param_types = {TYPE_I32, TYPE_I64, TYPE_I32};
+  Writer types;
+  types.VarU32(2);
+  types.Byte(TYPE_FUNC);
+  types.VarU32(0);
+  types.VarU32(0);
+  types.Byte(TYPE_FUNC);
+  types.VarU32(param_types.size());
+  for (uint8_t type : param_types) types.Byte(type);
+  types.VarU32(1);
+  types.Byte(TYPE_I32);
+  module.Section(1, types);
+
+  // Functions 0-2 are the imports, 3 is `_start`.
+  Writer imported;
+  imported.VarU32(3);
+  imported.Name("bench");
+  imported.Name("start");
+  imported.Byte(0);
+  imported.VarU32(0);
+  imported.Name("bench");
+  imported.Name("end");
+  imported.Byte(0);
+  imported.VarU32(0);
+  imported.Name("wasi_snapshot_preview1");
+  imported.Name(params.import);
+  imported.Byte(0);
+  imported.VarU32(1);
+  module.Section(2, imported);
+
+  Writer functions;
+  functions.VarU32(1);
+  functions.VarU32(0);
+  module.Section(3, functions);
+
+  Writer memory;
+  memory.VarU32(1);
+  memory.Byte(0);
+  memory.VarU32((HOSTCALL_BUFFER + params.size + 65535) / 65536);
+  module.Section(5, memory);
+
+  Writer exports;
+  exports.VarU32(2);
+  exports.Name("_start");
+  exports.Byte(0);
+  exports.VarU32(3);
+  exports.Name("memory");
+  exports.Byte(2);
+  exports.VarU32(0);
+  module.Section(7, exports);
+
+  Writer body;
+  body.VarU32(1);
+  body.VarU32(1);
+  body.Byte(TYPE_I32);
+  // iovec = {buffer, size}
+  body.I32Const(HOSTCALL_IOVEC);
+  body.I32Const(HOSTCALL_BUFFER);
+  body.Byte(OP_I32_STORE);
+  body.VarU32(2);
+  body.VarU32(0);
+  body.I32Const(HOSTCALL_IOVEC + 4);
+  body.I32Const(params.size);
+  body.Byte(OP_I32_STORE);
+  body.VarU32(2);
+  body.VarU32(0);
+
+  body.Byte(OP_CALL);
+  body.VarU32(0);
+  body.Byte(OP_LOOP);
+  body.Byte(BLOCK_VOID);
+  HostCallArgs(params, body);
+  body.Byte(OP_CALL);
+  body.VarU32(2);
+  body.Byte(OP_DROP);
+  body.Byte(OP_LOCAL_GET);
+  body.VarU32(0);
+  body.I32Const(1);
+  body.Byte(OP_I32_ADD);
+  body.Byte(OP_LOCAL_TEE);
+  body.VarU32(0);
+  body.I32Const(params.calls);
+  body.Byte(OP_I32_LT_U);
+  body.Byte(OP_BR_IF);
+  body.VarU32(0);
+  body.Byte(OP_END);
+  body.Byte(OP_CALL);
+  body.VarU32(1);
+  body.Byte(OP_END);
+
+  Writer code;
+  code.VarU32(1);
+  code.VarU32(body.bytes.size());
+  code.Append(body.bytes);
+  module.Section(10, code);
+
+  *out = std::move(module.bytes);
+  return true;
+}
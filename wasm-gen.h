@@ -0,0 +1,60 @@
+#ifndef WASM_GEN_H
+#define WASM_GEN_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+/// Shape of a module built by `GenerateWasmModule`. Every dimension can be
+/// varied on its own to find which one makes compilation scale badly.
+struct WasmGenParams {
+    /// Functions of type (i32) -> i32, besides the exported `_start`.
+    uint32_t functions = 100;
+    /// Statements per function body, each a handful of instructions.
+    uint32_t body_size = 50;
+    /// i32 locals per function, besides the parameter.
+    uint32_t locals = 4;
+    /// Depth of nested block/loop/if structures in each body.
+    uint32_t nesting = 0;
+    /// Fraction, 0 to 1, of statements that are v128 operations.
+    double simd_density = 0;
+    /// Calls each function makes, always to later functions so the call
+    /// graph stays acyclic. Calls pass the parameter on minus one and are
+    /// skipped unless it is positive, so `run(n)` nests at most n calls deep.
+    uint32_t fanout = 0;
+    uint32_t seed = 1;
+};
+
+/// Sets the parameter `name` (`functions`, `body-size`, `locals`,
+/// `nesting`, `simd-density`, `fanout` or `seed`) from `value`. Prints an
+/// error and returns false if either is invalid.
+bool SetWasmGenParam(const std::string &name, const std::string &value, WasmGenParams *out);
+
+/// Emits a valid module of the given shape. The module exports an empty
+/// `_start`, so it also runs under the bench driver, and `run`, the first
+/// generated function. With a fanout of 2 or more, `run(n)` can make
+/// exponentially many calls in n, so keep n small when executing it.
+void GenerateWasmModule(const WasmGenParams &params, std::vector<uint8_t> *out);
+
+/// A module whose `_start` calls one WASI import in a tight loop between
+/// `bench.start` and `bench.end`, for measuring host-call overhead.
+struct HostCallParams {
+    /// One of `HostCallImports()`.
+    std::string import;
+    /// Bytes per call for `fd_write` and `random_get`; ignored otherwise.
+    uint32_t size = 1;
+    uint32_t calls = 100000;
+};
+
+/// The WASI imports `GenerateHostCallModule` can call.
+const std::vector<std::string>& HostCallImports();
+
+/// Whether `import` moves `HostCallParams::size` bytes per call.
+bool HostCallIsSized(const std::string &import);
+
+/// Prints an error and returns false if `params.import` is not supported,
+/// `calls` is 0 or either value does not fit in an i32.
+bool GenerateHostCallModule(const HostCallParams &params, std::vector<uint8_t> *out);
+
+#endif // WASM_GEN_H
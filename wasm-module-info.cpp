@@ -0,0 +1,411 @@
+#include <stdio.h>
+
+#include <algorithm>
+#include <map>
+
+#include "wasm-module-info.h"
+
+namespace {
+
+enum SectionId : uint8_t {
+  SECTION_TYPE = 1,
+  SECTION_IMPORT = 2,
+  SECTION_FUNCTION = 3,
+  SECTION_MEMORY = 5,
+  SECTION_GLOBAL = 6,
+  SECTION_EXPORT = 7,
+  SECTION_CODE = 10,
+};
+
+enum ExternalKind : uint8_t {
+  KIND_FUNCTION = 0,
+  KIND_TABLE = 1,
+  KIND_MEMORY = 2,
+  KIND_GLOBAL = 3,
+  KIND_TAG = 4,
+};
+
+class Reader {
+ public:
+  Reader(const uint8_t *begin, const uint8_t *end) : cur_(begin), end_(end) {}
+
+  bool done() const { return cur_ == end_; }
+  const uint8_t *cur() const { return cur_; }
+  const uint8_t *end() const { return end_; }
+
+  bool ReadByte(uint8_t *out)
+  {
+    if (cur_ == end_) return false;
+    *out = *cur_++;
+    return true;
+  }
+
+  bool ReadVarU64(uint64_t *out)
+  {
+    uint64_t result = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      uint8_t byte;
+      if (!ReadByte(&byte)) return false;
+      result |= (uint64_t)(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        *out = result;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool ReadVarU32(uint32_t *out)
+  {
+    uint64_t value;
+    if (!ReadVarU64(&value) || value > UINT32_MAX) return false;
+    *out = (uint32_t)value;
+    return true;
+  }
+
+  // Signed LEB128, value discarded. Used for heap types and constants.
+  bool SkipVarS64()
+  {
+    uint8_t byte;
+    do {
+      if (!ReadByte(&byte)) return false;
+    } while (byte & 0x80);
+    return true;
+  }
+
+  bool ReadName(std::string *out)
+  {
+    uint32_t length;
+    if (!ReadVarU32(&length) || (size_t)(end_ - cur_) < length) return false;
+    out->assign((const char*)cur_, length);
+    cur_ += length;
+    return true;
+  }
+
+  bool Skip(size_t length)
+  {
+    if ((size_t)(end_ - cur_) < length) return false;
+    cur_ += length;
+    return true;
+  }
+
+ private:
+  const uint8_t *cur_;
+  const uint8_t *end_;
+};
+
+bool ReadLimits(Reader &r, WasmMemoryType *out)
+{
+  uint8_t flags;
+  if (!r.ReadByte(&flags)) return false;
+  out->shared = flags & 0x2;
+  out->is64 = flags & 0x4;
+  if (!r.ReadVarU64(&out->initial_pages)) return false;
+  if (flags & 0x1) {
+    uint64_t maximum;
+    if (!r.ReadVarU64(&maximum)) return false;
+    out->maximum_pages = maximum;
+  }
+  return true;
+}
+
+bool SkipValType(Reader &r)
+{
+  uint8_t type;
+  if (!r.ReadByte(&type)) return false;
+  // (ref null ht) and (ref ht) carry a heap type.
+  if (type == 0x63 || type == 0x64) return r.SkipVarS64();
+  return true;
+}
+
+bool ReadImportSection(Reader &r, WasmModuleInfo *out)
+{
+  uint32_t count;
+  if (!r.ReadVarU32(&count)) return false;
+  out->import_count = count;
+  for (uint32_t i = 0; i < count; i++) {
+    WasmMemoryImport import;
+    uint8_t kind;
+    if (!r.ReadName(&import.module) || !r.ReadName(&import.name) || !r.ReadByte(&kind)) {
+      return false;
+    }
+    uint32_t index;
+    uint8_t byte;
+    WasmMemoryType limits;
+    switch (kind) {
+      case KIND_FUNCTION:
+        if (!r.ReadVarU32(&index)) return false;
+        out->function_imports++;
+        break;
+      case KIND_TABLE:
+        if (!SkipValType(r) || !ReadLimits(r, &limits)) return false;
+        break;
+      case KIND_MEMORY:
+        if (!ReadLimits(r, &import.type)) return false;
+        out->memory_imports.push_back(std::move(import));
+        break;
+      case KIND_GLOBAL:
+        if (!SkipValType(r) || !r.ReadByte(&byte)) return false;
+        out->global_imports++;
+        break;
+      case KIND_TAG:
+        if (!r.ReadByte(&byte) || !r.ReadVarU32(&index)) return false;
+        break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+bool ReadFunctionSection(Reader &r, WasmModuleInfo *out)
+{
+  uint32_t count;
+  if (!r.ReadVarU32(&count)) return false;
+  out->function_count = count;
+  return true;
+}
+
+bool ReadMemorySection(Reader &r, WasmModuleInfo *out)
+{
+  uint32_t count;
+  if (!r.ReadVarU32(&count)) return false;
+  for (uint32_t i = 0; i < count; i++) {
+    WasmMemoryType type;
+    if (!ReadLimits(r, &type)) return false;
+    out->defined_memories.push_back(type);
+  }
+  return true;
+}
+
+// Skips a constant expression, up to and including its `end`.
+bool SkipConstExpr(Reader &r)
+{
+  for (;;) {
+    uint8_t op;
+    uint32_t index;
+    if (!r.ReadByte(&op)) return false;
+    switch (op) {
+      case 0x0b: // end
+        return true;
+      case 0x41: // i32.const
+      case 0x42: // i64.const
+      case 0xd0: // ref.null
+        if (!r.SkipVarS64()) return false;
+        break;
+      case 0x43: // f32.const
+        if (!r.Skip(4)) return false;
+        break;
+      case 0x44: // f64.const
+        if (!r.Skip(8)) return false;
+        break;
+      case 0x23: // global.get
+      case 0xd2: // ref.func
+        if (!r.ReadVarU32(&index)) return false;
+        break;
+      case 0xfd: // v128.const
+        if (!r.ReadVarU32(&index) || index != 12 || !r.Skip(16)) return false;
+        break;
+      case 0x6a: case 0x6b: case 0x6c: // extended-const i32.add/sub/mul
+      case 0x7c: case 0x7d: case 0x7e: // extended-const i64.add/sub/mul
+        break;
+      default:
+        return false;
+    }
+  }
+}
+
+// The value types JS can read and write through a function call.
+bool IsJsValType(uint8_t type)
+{
+  return type == 0x7f || type == 0x7e || type == 0x7d || type == 0x7c ||
+         type == 0x70 || type == 0x6f;
+}
+
+bool ReadGlobalSection(Reader &r, WasmModuleInfo *out)
+{
+  uint32_t count;
+  if (!r.ReadVarU32(&count)) return false;
+  for (uint32_t i = 0; i < count; i++) {
+    uint8_t type = r.done() ? 0 : *r.cur();
+    uint8_t mutability;
+    if (!SkipValType(r) || !r.ReadByte(&mutability) || !SkipConstExpr(r)) return false;
+    if ((mutability & 0x1) && IsJsValType(type)) {
+      out->internal_globals.push_back({uint32_t(out->global_imports + i), type});
+    }
+  }
+  return true;
+}
+
+bool ReadExportSection(Reader &r, WasmModuleInfo *out)
+{
+  uint32_t count;
+  if (!r.ReadVarU32(&count)) return false;
+  out->export_count = count;
+  for (uint32_t i = 0; i < count; i++) {
+    std::string name;
+    uint8_t kind;
+    uint32_t index;
+    if (!r.ReadName(&name) || !r.ReadByte(&kind) || !r.ReadVarU32(&index)) return false;
+    if (kind == KIND_GLOBAL) {
+      std::vector<WasmInternalGlobal> &globals = out->internal_globals;
+      globals.erase(std::remove_if(globals.begin(), globals.end(),
+                                   [&](const WasmInternalGlobal &g) { return g.index == index; }),
+                    globals.end());
+    }
+  }
+  return true;
+}
+
+bool ReadCodeSection(Reader &r, WasmModuleInfo *out)
+{
+  uint32_t count;
+  if (!r.ReadVarU32(&count)) return false;
+  // The function bodies, with their size prefixes.
+  out->code_bytes = r.end() - r.cur();
+  return true;
+}
+
+void WriteVarU32(std::vector<uint8_t> *out, uint32_t value)
+{
+  do {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    out->push_back(value ? byte | 0x80 : byte);
+  } while (value);
+}
+
+void WriteName(std::vector<uint8_t> *out, const std::string &name)
+{
+  WriteVarU32(out, name.size());
+  out->insert(out->end(), name.begin(), name.end());
+}
+
+// Entries appended to a vector section: their count and encoding.
+struct SectionTail {
+  uint32_t count = 0;
+  std::vector<uint8_t> bytes;
+};
+
+} // namespace
+
+bool ParseWasmModuleInfo(const uint8_t *bytes, size_t length, WasmModuleInfo *out)
+{
+  static const uint8_t header[8] = {0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00};
+  Reader r(bytes, bytes + length);
+  for (uint8_t expected : header) {
+    uint8_t byte;
+    if (!r.ReadByte(&byte) || byte != expected) return false;
+  }
+
+  while (!r.done()) {
+    uint8_t id;
+    uint32_t size;
+    if (!r.ReadByte(&id) || !r.ReadVarU32(&size)) return false;
+    const uint8_t *payload = r.cur();
+    if (!r.Skip(size)) return false;
+
+    Reader section(payload, payload + size);
+    bool ok = true;
+    switch (id) {
+      case SECTION_IMPORT: ok = ReadImportSection(section, out); break;
+      case SECTION_FUNCTION: ok = ReadFunctionSection(section, out); break;
+      case SECTION_CODE: ok = ReadCodeSection(section, out); break;
+      case SECTION_MEMORY: ok = ReadMemorySection(section, out); break;
+      case SECTION_GLOBAL: ok = ReadGlobalSection(section, out); break;
+      case SECTION_EXPORT: ok = ReadExportSection(section, out); break;
+      default: break;
+    }
+    if (!ok) return false;
+  }
+  return true;
+}
+
+std::string GlobalAccessorName(bool setter, uint32_t index)
+{
+  return (setter ? "sm-bench:set-global:" : "sm-bench:get-global:") + std::to_string(index);
+}
+
+bool AddGlobalAccessors(const uint8_t *bytes, size_t length, const WasmModuleInfo &info,
+                        std::vector<uint8_t> *out)
+{
+  // The existing entry counts of the sections to extend, and where their
+  // entries start.
+  std::map<uint8_t, std::pair<uint32_t, const uint8_t*>> vectors;
+  struct Section { uint8_t id; const uint8_t *begin, *end; };
+  std::vector<Section> sections;
+  if (length < 8) return false;
+  Reader r(bytes + 8, bytes + length);
+  while (!r.done()) {
+    Section section;
+    section.begin = r.cur();
+    uint32_t size;
+    if (!r.ReadByte(&section.id) || !r.ReadVarU32(&size)) return false;
+    const uint8_t *payload = r.cur();
+    if (!r.Skip(size)) return false;
+    section.end = r.cur();
+    sections.push_back(section);
+
+    if (section.id == SECTION_TYPE || section.id == SECTION_FUNCTION ||
+        section.id == SECTION_EXPORT || section.id == SECTION_CODE) {
+      Reader entries(payload, section.end);
+      uint32_t count;
+      if (!entries.ReadVarU32(&count)) return false;
+      vectors[section.id] = {count, entries.cur()};
+    }
+  }
+  for (uint8_t id : {SECTION_TYPE, SECTION_FUNCTION, SECTION_EXPORT, SECTION_CODE}) {
+    if (!vectors.count(id)) return false;
+  }
+
+  std::map<uint8_t, SectionTail> tails;
+  uint32_t type_index = vectors[SECTION_TYPE].first;
+  uint32_t function_index = info.function_imports + info.function_count;
+  for (const WasmInternalGlobal &global : info.internal_globals) {
+    for (bool setter : {false, true}) {
+      // (func (result T) global.get N) or (func (param T) local.get 0 global.set N)
+      SectionTail &types = tails[SECTION_TYPE];
+      if (setter) types.bytes.insert(types.bytes.end(), {0x60, 0x01, global.type, 0x00});
+      else types.bytes.insert(types.bytes.end(), {0x60, 0x00, 0x01, global.type});
+      types.count++;
+
+      SectionTail &functions = tails[SECTION_FUNCTION];
+      WriteVarU32(&functions.bytes, type_index++);
+      functions.count++;
+
+      std::vector<uint8_t> body = {0x00};
+      if (setter) body.insert(body.end(), {0x20, 0x00, 0x24});
+      else body.push_back(0x23);
+      WriteVarU32(&body, global.index);
+      body.push_back(0x0b);
+      SectionTail &code = tails[SECTION_CODE];
+      WriteVarU32(&code.bytes, body.size());
+      code.bytes.insert(code.bytes.end(), body.begin(), body.end());
+      code.count++;
+
+      SectionTail &exports = tails[SECTION_EXPORT];
+      WriteName(&exports.bytes, GlobalAccessorName(setter, global.index));
+      exports.bytes.push_back(KIND_FUNCTION);
+      WriteVarU32(&exports.bytes, function_index++);
+      exports.count++;
+    }
+  }
+
+  out->assign(bytes, bytes + 8);
+  for (const Section &section : sections) {
+    auto tail = tails.find(section.id);
+    if (tail == tails.end()) {
+      out->insert(out->end(), section.begin, section.end);
+      continue;
+    }
+    const auto &[count, entries] = vectors[section.id];
+    std::vector<uint8_t> payload;
+    WriteVarU32(&payload, count + tail->second.count);
+    payload.insert(payload.end(), entries, section.end);
+    payload.insert(payload.end(), tail->second.bytes.begin(), tail->second.bytes.end());
+    out->push_back(section.id);
+    WriteVarU32(out, payload.size());
+    out->insert(out->end(), payload.begin(), payload.end());
+  }
+  return true;
+}
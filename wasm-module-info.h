@@ -0,0 +1,70 @@
+#ifndef WASM_MODULE_INFO_H
+#define WASM_MODULE_INFO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <optional>
+#include <string>
+#include <vector>
+
+struct WasmMemoryType {
+    uint64_t initial_pages = 0;
+    std::optional<uint64_t> maximum_pages;
+    bool shared = false;
+    // memory64; mozjs-102 as configured here doesn't compile such modules.
+    bool is64 = false;
+};
+
+/// A mutable global the module defines but doesn't export.
+struct WasmInternalGlobal {
+    uint32_t index;
+    // The value type: one of i32, i64, f32, f64, funcref and externref.
+    uint8_t type;
+};
+
+struct WasmMemoryImport {
+    std::string module;
+    std::string name;
+    WasmMemoryType type;
+};
+
+/// The parts of a module's structure the driver needs before instantiation,
+/// read straight from the binary.
+struct WasmModuleInfo {
+    std::vector<WasmMemoryImport> memory_imports;
+    /// Memories defined (not imported) by the module.
+    std::vector<WasmMemoryType> defined_memories;
+    /// Mutable globals JS can't reach through the exports, e.g. the
+    /// `__stack_pointer` of wasi-libc modules.
+    std::vector<WasmInternalGlobal> internal_globals;
+
+    /// Module shape, for normalizing compile times.
+    size_t import_count = 0;
+    size_t function_imports = 0;
+    size_t global_imports = 0;
+    size_t export_count = 0;
+    /// Functions defined by the module, and the size of their bodies.
+    size_t function_count = 0;
+    size_t code_bytes = 0;
+};
+
+/// Parses the import, function, memory, global, export and code section
+/// headers of `bytes`. Returns false if the binary is malformed; other
+/// sections and function bodies are skipped unvalidated.
+bool ParseWasmModuleInfo(const uint8_t *bytes, size_t length, WasmModuleInfo *out);
+
+/// Name of the exported function `AddGlobalAccessors` adds to read or write
+/// the internal global `index`.
+std::string GlobalAccessorName(bool setter, uint32_t index);
+
+/// Copies `bytes` to `out` with a getter and a setter function exported for
+/// each of `info.internal_globals`. They are appended to the function index
+/// space, so existing functions keep their indices. Exporting the globals
+/// themselves would change their code: SpiderMonkey boxes exported mutable
+/// globals. Returns false if `bytes` has no export or code section to
+/// extend.
+bool AddGlobalAccessors(const uint8_t *bytes, size_t length, const WasmModuleInfo &info,
+                        std::vector<uint8_t> *out);
+
+#endif // WASM_MODULE_INFO_H